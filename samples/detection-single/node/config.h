@@ -12,9 +12,13 @@
 #ifndef CONFIG_H
 #define CONFIG_H
 
+// Model input size when the model does not tell
 #define INPUT_TENSOR_SIZE (300)
 #define MAX_BBOXES        (200)
 
+// Models kept in the workspace across restarts
+#define MODEL_CACHE_ENTRIES (2)
+
 #ifndef WINDOW_NAME
 #define WINDOW_NAME "Default Window"
 #endif
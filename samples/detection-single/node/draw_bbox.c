@@ -18,21 +18,12 @@
 #include <time.h>
 #include <unistd.h>
 
+#include "class_labels.h"
 #include "config.h"
 #include "logger.h"
-#include <opencv2/imgproc/imgproc_c.h>
-#include <opencv2/imgproc/types_c.h>
+#include "raster.h"
 
-#define MAX(x, y) (((x) > (y)) ? (x) : (y))
-#define MIN(x, y) (((x) < (y)) ? (x) : (y))
-
-typedef struct color {
-    uint8_t r;
-    uint8_t g;
-    uint8_t b;
-} color;
-
-static color bbox_color = {.r = 255, .g = 255, .b = 0};
+static raster_color_t bbox_color = {.r = 255, .g = 255, .b = 0};
 
 void
 change_color(uint8_t r, uint8_t g, uint8_t b)
@@ -44,31 +35,28 @@ change_color(uint8_t r, uint8_t g, uint8_t b)
 }
 
 int32_t
-frame_bbox(uint8_t *image, uint32_t size,
+frame_bbox(uint8_t *image, uint32_t width, uint32_t height,
            struct senscord_rectangle_region_parameter_t *crop, float cls,
            float score)
 {
-
-    CvMat *mat1 =
-        cvCreateMatHeader(INPUT_TENSOR_SIZE, INPUT_TENSOR_SIZE, CV_8UC3);
-    cvSetData(mat1, image, CV_AUTOSTEP);
     LOG_DBG("left, top, right, bottom = %d %d %d %d", crop->left, crop->top,
             crop->right, crop->bottom);
-    crop->left = MIN(MAX(crop->left, 0), INPUT_TENSOR_SIZE - 1);
-    crop->right = MIN(MAX(crop->right, 0), INPUT_TENSOR_SIZE - 1);
-    crop->top = MIN(MAX(crop->top, 0), INPUT_TENSOR_SIZE - 1);
-    crop->bottom = MIN(MAX(crop->bottom, 0), INPUT_TENSOR_SIZE - 1);
-    CvPoint p1 = {.x = crop->left, .y = crop->top};
-    CvPoint p2 = {.x = crop->right, .y = crop->bottom};
-    CvScalar color;
-    color.val[0] = bbox_color.r;
-    color.val[1] = bbox_color.g;
-    color.val[2] = bbox_color.b;
-    color.val[3] = 8;
-    //cvRectangle(mat, (top,left), (right,bottom), color, thickness, lineType, shift)
-    cvRectangle(mat1, &p1, &p2, &color, 1, 8, 0); 
-
-    cvGetData(mat1, image, INPUT_TENSOR_SIZE * INPUT_TENSOR_SIZE * 3);
-    cvReleaseMat(&mat1);
+    if (width == 0 || height == 0)
+        return -1;
+    // The edges are unsigned, so only the far side needs clamping.
+    crop->left = crop->left < width ? crop->left : width - 1;
+    crop->right = crop->right < width ? crop->right : width - 1;
+    crop->top = crop->top < height ? crop->top : height - 1;
+    crop->bottom = crop->bottom < height ? crop->bottom : height - 1;
+
+    // Drawn in place
+    raster_image_t img = {.data = image, .width = width, .height = height};
+    raster_rect(&img, crop->left, crop->top, crop->right, crop->bottom, 1,
+                bbox_color);
+
+    char label[CLASS_LABELS_TEXT_SIZE];
+    class_labels_format(label, sizeof(label), cls > 0 ? (uint32_t)cls : 0,
+                        score);
+    raster_label(&img, crop->left, crop->top, label, bbox_color);
     return 0;
 }
@@ -14,7 +14,7 @@
 
 #include "senscord/c_api/senscord_c_api.h"
 
-int32_t frame_bbox(uint8_t *image, uint32_t size,
+int32_t frame_bbox(uint8_t *image, uint32_t width, uint32_t height,
                    struct senscord_rectangle_region_parameter_t *crop,
                    float cls, float score);
 
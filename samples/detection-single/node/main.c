@@ -18,17 +18,21 @@
 #include <unistd.h>
 #include <stdbool.h>
 
+#include "class_labels.h"
 #include "config.h"
 #include "draw_bbox.h"
 #include "evp/sdk.h"
+#include "image_convert.h"
 #include "logger.h"
+#include "model_cache.h"
+#include "model_file.h"
 #include "nn.h"
 #include "parson.h"
 #include "senscord/c_api/senscord_c_api.h"
 #include "senscord_wasm.h"
 #include "sensor.h"
+#include "tensor_ops.h"
 #include "user_bridge_c.h"
-#include <opencv2/imgproc/imgproc_c.h>
 
 static struct EVP_client *h = NULL;
 
@@ -40,12 +44,20 @@ static senscord_stream_t stream = 0;
 static uint64_t rgb_handle = 0;
 static graph_execution_context ctx;
 
+// Model input size, read from the model once it is loaded
+static uint32_t input_width = INPUT_TENSOR_SIZE;
+static uint32_t input_height = INPUT_TENSOR_SIZE;
+static image_fit_t fit = IMAGE_FIT_STRETCH;
+
+// Quantized models take the frame bytes directly, shifted by 128 for int8
+// inputs.
+static tensor_type input_type = fp32;
+static bool input_signed = false;
+
 static char *model_url = NULL;
 static char *model_file = NULL;
 static bool downloaded_model = false;
 
-static uint32_t cam_width = 0;
-static uint32_t cam_height = 0;
 static struct senscord_image_sensor_function_property_t picture_quality = {
     .brightness = 0,
     .gain_value = 255,
@@ -53,9 +65,6 @@ static struct senscord_image_sensor_function_property_t picture_quality = {
     .sharpness = 255,
 };
 
-static bool is_yuv = false;
-static bool do_resize = false;
-
 typedef struct {
     float *bbox;
     float *score;
@@ -79,45 +88,21 @@ typedef struct {
     char *blob_url;
 } blob_cb_data_t;
 
-void
-convert_nv16_to_rgb(const uint8_t *nv16_data, uint8_t *rgb_data)
+static int
+convert_nv16_to_rgb(const frame_t *frame, const uint8_t *nv16_data,
+                    uint8_t *rgb_data)
 {
-    int size = cam_width * cam_height;
-    int rgb_data_size = INPUT_TENSOR_SIZE * INPUT_TENSOR_SIZE * 3;
-
-    LOG_DBG("is_yuv = %d, do-resize = %d", is_yuv, do_resize);
-    CvMat *mat2 = NULL;
-    if (is_yuv) {
-        uint8_t *yuv = (uint8_t *)malloc(size * 2);
-        for (int i = 0; i < size; ++i) {
-            yuv[i * 2] = nv16_data[i];
-            yuv[i * 2 + 1] = nv16_data[size + i];
-        }
-
-        CvMat *mat1 = cvCreateMat(cam_height, cam_width, CV_8UC2);
-        cvSetData(mat1, yuv, CV_AUTOSTEP);
-        mat2 = cvCreateMat(cam_height, cam_width, CV_8UC3);
-        cvCvtColor(mat1, mat2, CV_YUV2BGR_YUYV);
-        cvCvtColor(mat2, mat2, CV_BGR2RGB);
-        cvReleaseMat(&mat1);
-        free(yuv);
-    } else {
-        mat2 = cvCreateMat(cam_height, cam_width, CV_8UC3);
-        cvSetData(mat2, (void *)nv16_data, CV_AUTOSTEP);
-    }
-
-    if (do_resize) {
-        CvMat *mat3 =
-            cvCreateMat(INPUT_TENSOR_SIZE, INPUT_TENSOR_SIZE, CV_8UC3);
-        cvResize(mat2, mat3, CV_INTER_NN);
-
-        cvGetData(mat3, rgb_data, rgb_data_size);
-        cvReleaseMat(&mat3);
-    } else {
-        cvGetData(mat2, rgb_data, rgb_data_size);
+    const struct senscord_image_property_t *property =
+        &frame->info[0].property;
+    image_src_t src;
+    if (image_src_init(&src, nv16_data, property->width, property->height,
+                       property->stride_bytes, property->pixel_format) != 0) {
+        LOG_ERR("Unsupported pixel format %s", property->pixel_format);
+        return -1;
     }
-    cvReleaseMat(&mat2);
+    image_convert_rgb24_fit(&src, rgb_data, input_width, input_height, fit);
     LOG_INFO("Conversion to rgb done");
+    return 0;
 }
 
 static void
@@ -154,6 +139,7 @@ cleanup_inference_data(inference_data_t *inference_data)
 static int32_t
 inference(frame_t frame, inference_data_t *inference_data)
 {
+    int ret = 0;
     uint32_t raw_image_size = frame.info[0].rawdata.size;
     uint8_t *raw_image = (uint8_t *)malloc(raw_image_size);
     if (raw_image == NULL) {
@@ -164,24 +150,42 @@ inference(frame_t frame, inference_data_t *inference_data)
     senscord_memcpy((uint32_t)raw_image,
                     (uint64_t)frame.info[0].rawdata.address, raw_image_size);
 
-    uint32_t rgb_image_size = INPUT_TENSOR_SIZE * INPUT_TENSOR_SIZE * 3;
+    uint32_t rgb_image_size = input_width * input_height * 3;
     uint8_t *rgb_image = malloc(rgb_image_size);
-    convert_nv16_to_rgb(raw_image, rgb_image);
-
+    ret = convert_nv16_to_rgb(&frame, raw_image, rgb_image);
     free(raw_image);
-    float *input_tensor = (float *)malloc(rgb_image_size * sizeof(float));
-    for (int i = 0; i < rgb_image_size; ++i) {
-        input_tensor[i] = ((float)rgb_image[i]) / 255;
+    if (ret != 0) {
+        free(rgb_image);
+        return -1;
+    }
+
+    uint8_t *input_tensor = rgb_image;
+    if (input_type == fp32) {
+        input_tensor = malloc(rgb_image_size * sizeof(float));
+        tensor_normalize_u8(rgb_image, (float *)input_tensor, rgb_image_size);
+    } else if (input_signed) {
+        // rgb_image is still displayed afterwards, shift a copy.
+        input_tensor = malloc(rgb_image_size);
+        tensor_u8_to_i8(rgb_image, input_tensor, rgb_image_size);
     }
 
     uint64_t start_time = get_microsecond();
-    uint32_t dim[] = {1, INPUT_TENSOR_SIZE, INPUT_TENSOR_SIZE, 3};
-    if (wasm_set_input(ctx, (uint8_t *)input_tensor, (uint32_t *)dim) !=
-        success) {
+    uint32_t dim[] = {1, input_height, input_width, 3};
+    error err = wasm_set_input(ctx, input_tensor, dim, input_type);
+    if (input_tensor != rgb_image)
+        free(input_tensor);
+    if (err != success && input_type == up8) {
+        // The runtime does not take uint8 input; use float32 from the next
+        // frame on.
+        LOG_WARN("uint8 input rejected, falling back to float32");
+        input_type = fp32;
+        free(rgb_image);
+        return -1;
+    }
+    if (err != success) {
         fprintf(stderr, "Error when setting input tensor.");
         exit(1);
     }
-    free(input_tensor);
     if (wasm_compute(ctx) != success) {
         fprintf(stderr, "Error when running inference.");
         exit(1);
@@ -231,12 +235,12 @@ inference(frame_t frame, inference_data_t *inference_data)
                 continue;
             }
             struct senscord_rectangle_region_parameter_t crop_prop = {
-                inference_data->bbox[i * 4] * INPUT_TENSOR_SIZE,
-                inference_data->bbox[i * 4 + 1] * INPUT_TENSOR_SIZE,
-                inference_data->bbox[i * 4 + 2] * INPUT_TENSOR_SIZE,
-                inference_data->bbox[i * 4 + 3] * INPUT_TENSOR_SIZE};
-            frame_bbox(rgb_image, rgb_image_size, &crop_prop,
-                       inference_data->score[i], inference_data->class[i]);
+                inference_data->bbox[i * 4] * input_height,
+                inference_data->bbox[i * 4 + 1] * input_width,
+                inference_data->bbox[i * 4 + 2] * input_height,
+                inference_data->bbox[i * 4 + 3] * input_width};
+            frame_bbox(rgb_image, input_width, input_height, &crop_prop,
+                       inference_data->class[i], inference_data->score[i]);
         }
     }
     senscord_ub_send_data(rgb_handle, rgb_image);
@@ -294,6 +298,8 @@ blob_cb(EVP_BLOB_CALLBACK_REASON reason, const void *vp, void *userData)
         LOG_INFO("result=%u "
                  "http_status=%u error=%d",
                  result->result, result->http_status, result->error);
+        if (result->result == EVP_BLOB_RESULT_SUCCESS)
+            model_file = model_cache_insert(cb_data->blob_url);
         break;
     case EVP_BLOB_CALLBACK_REASON_EXIT:
         assert(vp == NULL);
@@ -313,15 +319,24 @@ blob_cb(EVP_BLOB_CALLBACK_REASON reason, const void *vp, void *userData)
 static void
 download_model()
 {
+    model_file = model_cache_lookup(model_url);
+    if (model_file != NULL) {
+        LOG_INFO("Using cached model %s", model_file);
+        downloaded_model = true;
+        return;
+    }
+
     LOG_DBG("Loading model from: %s", model_url);
-    module_vars_t module_vars;
+    // Completed asynchronously from EVP_processEvent, so these must outlive
+    // this call.
+    static module_vars_t module_vars;
+    static blob_cb_data_t cb_data;
     module_vars.download = strdup(model_url);
-    module_vars.filename = strdup(model_file);
+    module_vars.filename = strdup(model_cache_download_path());
     module_vars.localStore.filename = module_vars.filename;
     module_vars.localStore.io_cb = NULL;
     module_vars.localStore.blob_len = 0;
 
-    blob_cb_data_t cb_data;
     cb_data.blob_url = module_vars.download;
     cb_data.ctx = &module_vars;
 
@@ -345,6 +360,12 @@ rpc_callback(EVP_RPC_ID id, const char *methodName, const char *params,
         JSON_Object *object = json_value_get_object(schema);
         stream_key = strdup(json_object_dotget_string(object, "stream"));
         model_url = strdup(json_object_dotget_string(object, "model"));
+        const char *fit_name = json_object_dotget_string(object, "fit");
+        if (fit_name != NULL && image_fit_parse(fit_name, &fit) != 0)
+            LOG_WARN("Unknown fit %s", fit_name);
+        JSON_Array *labels = json_object_get_array(object, "labels");
+        if (labels != NULL)
+            class_labels_load(labels);
         json_value_free(schema);
     } else if (strcmp(methodName, "rgb") == 0) {
         int r, g, b;
@@ -381,11 +402,7 @@ main()
     const char *workspace =
         EVP_getWorkspaceDirectory(h, EVP_WORKSPACE_TYPE_DEFAULT);
 
-    ret = asprintf(&model_file, "%s/%s", workspace, "detection.tflite");
-    if (ret == -1) {
-        LOG_ERR("Error while creating model file name");
-        return -1;
-    }
+    model_cache_init(workspace, MODEL_CACHE_ENTRIES);
 
     while (stream_key == NULL || model_url == NULL) {
         result = EVP_processEvent(h, 10);
@@ -403,14 +420,36 @@ main()
             break;
         }
     }
+    if (model_file == NULL) {
+        LOG_ERR("Model download failed.");
+        goto END;
+    }
     LOG_INFO("Model is downloaded!");
 
     /* prepare inference*/
     graph graph;
-    if (wasm_load(model_file, &graph, cpu) != success) {
+    tflite_tensor_info_t input_info;
+    uint64_t load_start = get_microsecond();
+    if (wasm_load(model_file, &graph, cpu, &input_info) != success) {
         LOG_ERR("Error when loading model.");
         goto END;
     }
+    LOG_DBG("Model load time: %f ms, linear memory %zu bytes",
+            (get_microsecond() - load_start) / 1000.0,
+            model_file_memory_size());
+    if (input_info.type == TFLITE_UINT8 || input_info.type == TFLITE_INT8) {
+        input_type = up8;
+        input_signed = input_info.type == TFLITE_INT8;
+    }
+    if (input_info.num_dims == 4 && input_info.dims[3] == 3 &&
+        input_info.dims[1] > 0 && input_info.dims[2] > 0) {
+        // NHWC
+        input_height = input_info.dims[1];
+        input_width = input_info.dims[2];
+    }
+    LOG_INFO("Model input %ux%u, type %d, feeding %s", input_width,
+             input_height, input_info.type,
+             input_type == fp32 ? "float32" : "uint8");
 
     if (wasm_init_execution_context(graph, &ctx) != success) {
         LOG_ERR("Error when initialixing execution context.");
@@ -425,8 +464,8 @@ main()
     LOG_INFO("Sensor opened!");
 
     rgb_handle = senscord_ub_create_stream(
-        WINDOW_NAME, INPUT_TENSOR_SIZE, INPUT_TENSOR_SIZE,
-        INPUT_TENSOR_SIZE * 3, SENSCORD_PIXEL_FORMAT_RGB24);
+        WINDOW_NAME, input_width, input_height, input_width * 3,
+        SENSCORD_PIXEL_FORMAT_RGB24);
     if (rgb_handle == 0) {
         LOG_ERR("CreateStream failed.");
         goto END;
@@ -454,14 +493,6 @@ main()
         LOG_DBG("image_property pixel_format = %s",
                  frame.info[0].property.pixel_format);
 
-        do_resize = frame.info[0].property.height != INPUT_TENSOR_SIZE |
-                    frame.info[0].property.width != INPUT_TENSOR_SIZE;
-        is_yuv =
-            strcmp(frame.info[0].property.pixel_format, "image_nv16") == 0;
-
-        cam_height = frame.info[0].property.height;
-        cam_width = frame.info[0].property.width;
-
         inference_data_t inference_data = {0};
         ret = inference(frame, &inference_data);
         if (ret != 0) {
@@ -490,6 +521,8 @@ main()
 END:
     if (model_file != NULL)
         free(model_file);
+    model_cache_deinit();
+    class_labels_free();
     if (rgb_handle != 0)
         senscord_ub_destroy_stream(rgb_handle);
     if (stream != 0 && core != 0) {
@@ -14,39 +14,24 @@
 #include <string.h>
 
 #include "logger.h"
+#include "model_file.h"
 
 // WASI-NN wrappers
 
 error
-wasm_load(char *model_name, graph *g, execution_target target)
+wasm_load(char *model_name, graph *g, execution_target target,
+          tflite_tensor_info_t *input_info)
 {
-    FILE *pFile = fopen(model_name, "r");
-    if (pFile == NULL)
-        return invalid_argument;
-
-    uint8_t *buffer;
     size_t result;
-
-    // allocate memory to contain the whole file:
-    buffer = (uint8_t *)malloc(sizeof(uint8_t) * MAX_MODEL_SIZE);
-    if (buffer == NULL) {
-        fclose(pFile);
-        return missing_memory;
-    }
-
-    result = fread(buffer, 1, MAX_MODEL_SIZE, pFile);
-    if (result <= 0) {
-        fclose(pFile);
-        free(buffer);
-        return missing_memory;
-    }
+    uint8_t *buffer = model_file_read(model_name, &result);
+    if (buffer == NULL)
+        return invalid_argument;
 
     graph_builder_array arr;
 
     arr.size = 1;
     arr.buf = (graph_builder *)malloc(sizeof(graph_builder));
     if (arr.buf == NULL) {
-        fclose(pFile);
         free(buffer);
         return missing_memory;
     }
@@ -57,7 +42,13 @@ wasm_load(char *model_name, graph *g, execution_target target)
     // WASI-NN 
     error res = load(&arr, tensorflowlite, target, g);
 
-    fclose(pFile);
+    // wasi-nn cannot be queried for the input type; read it from the model.
+    if (tflite_input_info(buffer, result, 0, input_info) != 0) {
+        LOG_WARN("Could not read the model input tensor, assuming float32");
+        memset(input_info, 0, sizeof(*input_info));
+        input_info->type = TFLITE_FLOAT32;
+    }
+
     free(buffer);
     free(arr.buf);
     return res;
@@ -72,7 +63,7 @@ wasm_init_execution_context(graph g, graph_execution_context *ctx)
 
 error
 wasm_set_input(graph_execution_context ctx, uint8_t *input_tensor,
-               uint32_t *dim)
+               uint32_t *dim, tensor_type type)
 {
     tensor_dimensions dims;
     dims.size = INPUT_TENSOR_DIMS;
@@ -84,7 +75,7 @@ wasm_set_input(graph_execution_context ctx, uint8_t *input_tensor,
     tensor.dimensions = &dims;
     for (int i = 0; i < tensor.dimensions->size; ++i)
         tensor.dimensions->buf[i] = dim[i];
-    tensor.type = ip32;
+    tensor.type = type;
     tensor.data = (uint8_t *)input_tensor;
     // WASI-NN 
     error err = set_input(ctx, 0, &tensor);
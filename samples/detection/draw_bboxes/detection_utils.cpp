@@ -3,51 +3,70 @@
 #include "postprocessed_detection_generated.h"
 
 #define MIN(x, y) (((x) < (y)) ? x : y)
-#define MAX(x, y) (((x) > (y)) ? x : y)
 
-extern "C" detections *
-get_detections(char *fbs_ptr)
+extern "C" uint32_t
+get_detections(const void *fbs_ptr, detection *out, uint32_t max,
+               uint32_t *frame_id)
 {
     LOG_DBG("In apply");
     auto postprocessed = postprocessed::GetDetection(fbs_ptr);
+    *frame_id = postprocessed->frame_id();
     auto annotations = postprocessed->annotations();
-    int size = annotations->size();
-    LOG_DBG("Number of annotations: %d", size);
+    uint32_t size = annotations ? annotations->size() : 0;
+    LOG_DBG("Number of annotations: %u", size);
+    auto track_ids = postprocessed->track_ids();
+    uint32_t num_ids = track_ids ? track_ids->size() : 0;
+    auto classes = postprocessed->cascade_classes();
+    auto scores = postprocessed->cascade_scores();
+    uint32_t num_labels = classes && scores ? classes->size() : 0;
+    if (scores && scores->size() < num_labels)
+        num_labels = scores->size();
 
-    detections *dets = (detections *)malloc(sizeof(detections));
-    dets->detections = (detection *)malloc(size * sizeof(detection));
-    dets->size = size;
-
-    for (int i = 0; i < size; ++i) {
+    uint32_t n = 0;
+    for (uint32_t i = 0; i < size && n < max; ++i) {
         auto ann = annotations->Get(i);
+        out[n++] = {.x_min = ann->bbox().x_min(),
+                    .y_min = ann->bbox().y_min(),
+                    .x_max = ann->bbox().x_max(),
+                    .y_max = ann->bbox().y_max(),
+                    .category = (uint32_t)ann->category(),
+                    .score = ann->prob(),
+                    .track_id = i < num_ids ? track_ids->Get(i) : 0,
+                    .cascade_class = i < num_labels ? classes->Get(i) : 0,
+                    .cascade_score = i < num_labels ? scores->Get(i) : 0};
+    }
+    return n;
+}
 
-        uint32_t y_min = HEIGHT * ann->bbox().y_min();
-        uint32_t y_max = HEIGHT * ann->bbox().y_max();
-        uint32_t x_min = WIDTH * ann->bbox().x_min();
-        uint32_t x_max = WIDTH * ann->bbox().x_max();
+// Normalized coordinate to a pixel index in [0, size - 1].
+static int32_t
+to_pixel(float v, int32_t size)
+{
+    v = !(v > 0) ? 0 : v > 1 ? 1 : v;
+    return MIN((int32_t)(v * size), size - 1);
+}
 
-        y_min = MIN(MAX(y_min, 0), HEIGHT - 1);
-        y_max = MIN(MAX(y_max, 0), HEIGHT - 1);
-        x_min = MIN(MAX(x_min, 0), WIDTH - 1);
-        x_max = MIN(MAX(x_max, 0), WIDTH - 1);
+extern "C" bool
+detection_to_pixels(const detection *d, uint32_t width, uint32_t height,
+                    detection_box *box)
+{
+    int32_t w = width, h = height;
+    int32_t y_min = to_pixel(d->y_min, h);
+    int32_t y_max = to_pixel(d->y_max, h);
+    int32_t x_min = to_pixel(d->x_min, w);
+    int32_t x_max = to_pixel(d->x_max, w);
 
-        LOG_DBG("%d %d %d %d", y_min, y_max, x_min, x_max);
-        if (y_min >= y_max) {
-            y_max = y_min + 1;
-            if (y_max >= HEIGHT)
-                continue;
-        }
-        if (x_min >= x_max) {
-            x_max = x_min + 1;
-            if (x_max >= WIDTH)
-                continue;
-        }
-        dets->detections[i] = {.x_min = x_min,
-                               .y_min = y_min,
-                               .x_max = x_max,
-                               .y_max = y_max,
-                               .category = (uint32_t)ann->category(),
-                               .score = ann->prob()};
+    LOG_DBG("%d %d %d %d", y_min, y_max, x_min, x_max);
+    if (y_min >= y_max) {
+        y_max = y_min + 1;
+        if (y_max >= h)
+            return false;
+    }
+    if (x_min >= x_max) {
+        x_max = x_min + 1;
+        if (x_max >= w)
+            return false;
     }
-    return dets;
+    *box = {.x_min = x_min, .y_min = y_min, .x_max = x_max, .y_max = y_max};
+    return true;
 }
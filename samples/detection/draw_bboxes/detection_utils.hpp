@@ -1,6 +1,7 @@
 #ifndef APPLY_HPP
 #define APPLY_HPP
 
+// Size of frames without metadata
 #ifndef WIDTH
 #define WIDTH 300
 #endif
@@ -11,25 +12,52 @@
 #include <stdint.h>
 #include <stdio.h>
 
+#include <stdbool.h>
+
+// Box with coordinates normalized to the frame, as detected; the frame it
+// is drawn on may arrive later.
 typedef struct {
-    uint32_t x_min;
-    uint32_t y_min;
-    uint32_t x_max;
-    uint32_t y_max;
+    float x_min;
+    float y_min;
+    float x_max;
+    float y_max;
     uint32_t category;
     float score;
+    // Set by the tracker; 0 for none
+    uint32_t track_id;
+    // Top class of the second stage of a cascade, if cascade_score > 0
+    uint32_t cascade_class;
+    float cascade_score;
 } detection;
 
+// Box in pixels, inclusive
 typedef struct {
-    detection *detections;
-    uint32_t size;
-} detections;
+    int32_t x_min;
+    int32_t y_min;
+    int32_t x_max;
+    int32_t y_max;
+} detection_box;
 
 #ifdef __cplusplus
 extern "C" {
 #endif
 
-detections *get_detections(char *fbs_ptr);
+/**
+ * Read up to `max` boxes of a Detection buffer into `out`, and its source
+ * frame id into `frame_id` (0 if the producer did not set it).
+ *
+ * @return the number of boxes written.
+ */
+uint32_t get_detections(const void *fbs_ptr, detection *out, uint32_t max,
+                        uint32_t *frame_id);
+
+/**
+ * Place `d` on a `width` x `height` frame, at least one pixel wide and high.
+ *
+ * @return false if the box falls outside the frame.
+ */
+bool detection_to_pixels(const detection *d, uint32_t width, uint32_t height,
+                         detection_box *box);
 
 #ifdef __cplusplus
 }
@@ -1,83 +1,309 @@
+#include <stdbool.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
 #include <time.h>
 #include <unistd.h>
 
+#include "class_labels.h"
 #include "detection_utils.hpp"
 #include "evp/sdk.h"
+#include "frame_meta.h"
 #include "logger.h"
+#include "parson.h"
+#include "raster.h"
 #include <assert.h>
-#include <opencv2/imgproc/imgproc_c.h>
-#include <opencv2/imgproc/types_c.h>
-
-struct send_message_cb_data {
-    char *topic;
-    char *payload;
-};
 
 #define INPUT_TOPIC_DETECTIONS "detections"
+#define OUTPUT_TOPIC           "postprocessed_image"
+
+// Frames and detections waiting for their counterpart
+#define JOIN_RING_SIZE 4
+// Entries older than this are dropped unmatched
+#define JOIN_MAX_AGE_MS 2000
+// Boxes drawn per frame; the PPL reports at most 100
+#define MAX_DETECTIONS 100
 
 static const char *module_name = "OPENCV";
 static struct EVP_client *h;
 
-// pointer to the image or buffer that contains the native address
-static char *image = NULL;
-static int32_t image_size = 0;
-static char *anns = NULL;
-static int32_t anns_size = 0;
+// A frame and its detections, joined by frame id. Either half may arrive
+// first; the entry is drawn once both are there.
+struct join_entry {
+    uint32_t frame_id;
+    uint64_t arrived_ms;
+    // Allocated on first use and kept. The boxes are drawn into it and the
+    // same buffer is sent on, so the entry is busy until the send is done.
+    uint8_t *image;
+    uint32_t image_capacity;
+    // 0 while the frame has not arrived
+    uint32_t image_size;
+    uint32_t width;
+    uint32_t height;
+    bool has_dets;
+    bool sending;
+    uint32_t num_dets;
+    detection dets[MAX_DETECTIONS];
+};
+
+static struct join_entry ring[JOIN_RING_SIZE];
+
+// Outline width in pixels, at most
+#define MAX_THICKNESS 16
+
+static raster_color_t bbox_color = {.r = 255, .g = 255, .b = 0};
+// Colors of the classes that do not use bbox_color
+static raster_color_t class_colors[CLASS_LABELS_MAX];
+static bool has_class_color[CLASS_LABELS_MAX];
+static uint32_t thickness = 1;
+// Opacity of the box interior in 1/256 steps, 0 for outlines only
+static uint32_t fill_alpha = 0;
+
+static bool
+parse_color(const char *hex, raster_color_t *color)
+{
+    uint32_t hex_value;
+    if (hex == NULL || sscanf(hex, "%X", &hex_value) != 1) {
+        LOG_WARN("Invalid color %s", hex != NULL ? hex : "(null)");
+        return false;
+    }
+    color->r = (hex_value >> 16) & 0xFF;
+    color->g = (hex_value >> 8) & 0xFF;
+    color->b = hex_value & 0xFF;
+    return true;
+}
 
-typedef struct color {
-    uint8_t r;
-    uint8_t g;
-    uint8_t b;
-} color;
+static raster_color_t
+color_of(uint32_t cls)
+{
+    if (cls < CLASS_LABELS_MAX && has_class_color[cls])
+        return class_colors[cls];
+    return bbox_color;
+}
 
-static color bbox_color = {.r = 255, .g = 255, .b = 0};
+static void
+set_class_colors(const JSON_Array *colors)
+{
+    memset(has_class_color, 0, sizeof(has_class_color));
+    size_t count = json_array_get_count(colors);
+    for (size_t i = 0; i < count && i < CLASS_LABELS_MAX; ++i) {
+        const char *hex = json_array_get_string(colors, i);
+        if (hex != NULL)
+            has_class_color[i] = parse_color(hex, &class_colors[i]);
+    }
+}
 
+static void
+apply_config(const JSON_Object *object)
+{
+    const char *color = json_object_get_string(object, "color");
+    if (color != NULL)
+        parse_color(color, &bbox_color);
+    JSON_Array *colors = json_object_get_array(object, "colors");
+    if (colors != NULL)
+        set_class_colors(colors);
+    JSON_Array *labels = json_object_get_array(object, "labels");
+    if (labels != NULL)
+        class_labels_load(labels);
+    if (json_object_has_value_of_type(object, "thickness", JSONNumber)) {
+        double t = json_object_get_number(object, "thickness");
+        thickness = t < 1 ? 1 : t > MAX_THICKNESS ? MAX_THICKNESS : t;
+    }
+    if (json_object_has_value_of_type(object, "fill_opacity", JSONNumber)) {
+        double a = json_object_get_number(object, "fill_opacity");
+        fill_alpha = a <= 0 ? 0 : a >= 1 ? 256 : (uint32_t)(a * 256 + 0.5);
+    }
+    LOG_INFO("Boxes: color %02X%02X%02X, thickness %u, fill %u/256",
+             bbox_color.r, bbox_color.g, bbox_color.b, thickness, fill_alpha);
+}
+
+// Either a JSON object, see README.md, or, as before the overlay was
+// configurable, a bare hex color.
 static void
 config_cb(const char *topic, const void *config, size_t configlen,
           void *userData)
 {
     LOG_DBG("Inside config_cb");
-    uint32_t hex_value;
-    sscanf(config, "%X", &hex_value);
-    bbox_color.r = (hex_value >> 16) & 0xFF;
-    bbox_color.g = (hex_value >> 8) & 0xFF;
-    bbox_color.b = hex_value & 0xFF;
-    LOG_INFO("New bounding box color: %d %d %d", bbox_color.r, bbox_color.g,
-             bbox_color.b);
+    char *text = strndup(config, configlen);
+    if (text == NULL)
+        return;
+    JSON_Value *value = json_parse_string(text);
+    JSON_Object *object = json_value_get_object(value);
+    if (object != NULL)
+        apply_config(object);
+    else if (parse_color(text, &bbox_color))
+        LOG_INFO("New bounding box color: %d %d %d", bbox_color.r,
+                 bbox_color.g, bbox_color.b);
+    json_value_free(value);
+    free(text);
+}
+
+static uint64_t
+now_ms(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000 + ts.tv_nsec / 1000000;
+}
+
+// Frame ids wrap, so compare them by distance.
+static bool
+frame_before(uint32_t a, uint32_t b)
+{
+    return (int32_t)(a - b) < 0;
+}
+
+static bool
+entry_pending(const struct join_entry *e)
+{
+    return e->image_size != 0 || e->has_dets;
+}
+
+// Forget the contents, keeping the image buffer.
+static void
+entry_clear(struct join_entry *e)
+{
+    e->frame_id = 0;
+    e->image_size = 0;
+    e->has_dets = false;
+    e->num_dets = 0;
 }
 
 static void
-send_message_cb(EVP_MESSAGE_SENT_CALLBACK_REASON reason, void *userData)
-{
-    struct send_message_cb_data *d = userData;
-    assert(d != NULL);
-    assert(d->topic != NULL);
-    assert(d->payload != NULL);
-    free(d->topic);
-    free(d->payload);
-    free(d);
-}
-
-void
-send_message(char *topic, char *payload, uint32_t size)
-{
-    struct send_message_cb_data *d = malloc(sizeof(*d));
-    assert(d != NULL);
-    d->topic = strdup(topic);
-    assert(d->topic != NULL);
-    d->payload = payload;
-    EVP_RESULT result =
-        EVP_sendMessage(h, d->topic, d->payload, size, send_message_cb, d);
-    LOG_DBG("%s: send_message topic=%s, size=%d", module_name, d->topic,
-             size);
+evict_expired(uint64_t now)
+{
+    for (int i = 0; i < JOIN_RING_SIZE; ++i) {
+        struct join_entry *e = &ring[i];
+        if (entry_pending(e) && now - e->arrived_ms > JOIN_MAX_AGE_MS) {
+            LOG_DBG("Dropping unmatched frame %u", e->frame_id);
+            entry_clear(e);
+        }
+    }
+}
+
+// Entry for `frame_id`, or a new one, evicting the oldest if the ring is
+// full. Id 0 comes from producers without frame metadata: detections
+// without an id join the newest frame, as before frames had ids.
+//
+// Returns NULL if every entry is still being sent.
+static struct join_entry *
+entry_get(uint32_t frame_id, bool is_image, uint64_t now)
+{
+    struct join_entry *found = NULL, *free_entry = NULL, *oldest = NULL;
+    for (int i = 0; i < JOIN_RING_SIZE; ++i) {
+        struct join_entry *e = &ring[i];
+        if (e->sending)
+            continue;
+        if (!entry_pending(e)) {
+            if (free_entry == NULL)
+                free_entry = e;
+            continue;
+        }
+        if (oldest == NULL || e->arrived_ms < oldest->arrived_ms)
+            oldest = e;
+        if (frame_id == 0 && !is_image) {
+            if (e->image_size != 0 && !e->has_dets &&
+                (found == NULL || e->arrived_ms >= found->arrived_ms))
+                found = e;
+        } else if (e->frame_id == frame_id &&
+                   (is_image ? e->image_size == 0 : !e->has_dets)) {
+            found = e;
+        }
+    }
+    if (found != NULL)
+        return found;
+    if (free_entry == NULL) {
+        if (oldest == NULL)
+            return NULL;
+        LOG_DBG("Join ring full, dropping frame %u", oldest->frame_id);
+        entry_clear(oldest);
+        free_entry = oldest;
+    }
+    free_entry->frame_id = frame_id;
+    free_entry->arrived_ms = now;
+    return free_entry;
+}
+
+static void
+image_sent_cb(EVP_MESSAGE_SENT_CALLBACK_REASON reason, void *userData)
+{
+    struct join_entry *e = userData;
+    assert(e != NULL);
+    e->sending = false;
+}
+
+static void
+draw_and_send(struct join_entry *e)
+{
+    raster_image_t img = {
+        .data = e->image, .width = e->width, .height = e->height};
+    // Room for "#<track id> " before the class label, and for the
+    // " / <class> <score>%" of a cascade after it
+    char label[12 + CLASS_LABELS_TEXT_SIZE + 20];
+    for (uint32_t i = 0; i < e->num_dets; ++i) {
+        const detection *d = &e->dets[i];
+        detection_box b;
+        if (!detection_to_pixels(d, e->width, e->height, &b))
+            continue;
+        raster_color_t color = color_of(d->category);
+        raster_blend_rect(&img, b.x_min, b.y_min, b.x_max, b.y_max, color,
+                          fill_alpha);
+        raster_rect(&img, b.x_min, b.y_min, b.x_max, b.y_max, thickness,
+                    color);
+        size_t n = 0;
+        if (d->track_id != 0) {
+            label[n++] = '#';
+            n = class_labels_append_uint(label, n, sizeof(label),
+                                         d->track_id);
+            label[n++] = ' ';
+        }
+        n += class_labels_format(label + n, CLASS_LABELS_TEXT_SIZE,
+                                 d->category, d->score);
+        if (d->cascade_score > 0) {
+            label[n++] = ' ';
+            label[n++] = '/';
+            label[n++] = ' ';
+            n = class_labels_append_uint(label, n, sizeof(label),
+                                         d->cascade_class);
+            label[n++] = ' ';
+            n = class_labels_append_score(label, n, sizeof(label),
+                                          d->cascade_score);
+            label[n] = '\0';
+        }
+        raster_label(&img, b.x_min, b.y_min, label, color);
+    }
+
+    LOG_DBG("%s: send_message topic=%s, size=%u", module_name, OUTPUT_TOPIC,
+            e->image_size);
+    e->sending = true;
+    EVP_RESULT result = EVP_sendMessage(h, OUTPUT_TOPIC, e->image,
+                                        e->image_size, image_sent_cb, e);
     if (EVP_OK != result) {
-        LOG_ERR("%s %s %d: calling EVP_sendMessage", module_name, d->topic,
-                result);
+        LOG_ERR("%s %s %d: calling EVP_sendMessage", module_name,
+                OUTPUT_TOPIC, result);
+        e->sending = false;
     }
-    assert(result == EVP_OK);
+}
+
+static bool
+store_image(struct join_entry *e, const void *payload, size_t size,
+            const frame_meta_t *meta)
+{
+    if (size > e->image_capacity) {
+        uint8_t *p = realloc(e->image, size);
+        if (p == NULL) {
+            LOG_ERR("Cannot allocate %zu bytes for a frame", size);
+            return false;
+        }
+        e->image = p;
+        e->image_capacity = size;
+    }
+    // The only copy of the frame: it is drawn and sent from here.
+    memcpy(e->image, payload, size);
+    e->image_size = size;
+    e->width = meta->width;
+    e->height = meta->height;
+    return true;
 }
 
 static void
@@ -87,51 +313,64 @@ message_cb(const char *topic, const void *msgPayload, size_t msgPayloadLen,
     LOG_DBG("%s: Received Message (topic=%s, size=%zu)", module_name, topic,
              msgPayloadLen);
 
-    char **dst = NULL;
-    if (strcmp(topic, INPUT_TOPIC_DETECTIONS) == 0) {
-        anns_size = msgPayloadLen;
-        dst = (char **)&anns;
+    uint64_t now = now_ms();
+    evict_expired(now);
+
+    bool is_image = strcmp(topic, INPUT_TOPIC_DETECTIONS) != 0;
+    uint32_t frame_id;
+    frame_meta_t meta;
+    detection dets[MAX_DETECTIONS];
+    uint32_t num_dets = 0;
+    if (is_image) {
+        if (!frame_meta_read(msgPayload, msgPayloadLen, &meta)) {
+            if (msgPayloadLen < WIDTH * HEIGHT * 3) {
+                LOG_WARN("Frame of %zu bytes is too small", msgPayloadLen);
+                return;
+            }
+            meta.width = WIDTH;
+            meta.height = HEIGHT;
+        }
+        frame_id = meta.frame_id;
     } else {
-        image_size = msgPayloadLen;
-        dst = (char **)&image;
+        if (msgPayloadLen == 0)
+            return;
+        num_dets =
+            get_detections(msgPayload, dets, MAX_DETECTIONS, &frame_id);
     }
-    if (*dst)
-        free(*dst);
-    *dst = (char *)malloc(msgPayloadLen);
-    memcpy(*dst, msgPayload, msgPayloadLen);
 
-    if (image_size == 0 || anns_size == 0)
+    struct join_entry *e = entry_get(frame_id, is_image, now);
+    if (e == NULL) {
+        LOG_WARN("All frames are still being sent, dropping frame %u",
+                 frame_id);
         return;
-
-    detections *dets = get_detections(anns);
-
-    CvMat *mat1 = cvCreateMatHeader(300, 300, CV_8UC3);
-    cvSetData(mat1, image, CV_AUTOSTEP);
-
-    for (int i = 0; i < dets->size; ++i) {
-        CvPoint p1 = {.x = dets->detections[i].x_min,
-                      .y = dets->detections[i].y_min};
-        CvPoint p2 = {.x = dets->detections[i].x_max,
-                      .y = dets->detections[i].y_max};
-        CvScalar color;
-        color.val[0] = bbox_color.r;
-        color.val[1] = bbox_color.g;
-        color.val[2] = bbox_color.b;
-        color.val[3] = 8;
-        cvRectangle(mat1, &p1, &p2, &color, 1, 8, 0);
+    }
+    if (is_image) {
+        if (!store_image(e, msgPayload, msgPayloadLen, &meta)) {
+            entry_clear(e);
+            return;
+        }
+    } else {
+        memcpy(e->dets, dets, num_dets * sizeof(dets[0]));
+        e->num_dets = num_dets;
+        e->has_dets = true;
     }
 
-    cvGetData(mat1, image, 300 * 300 * 3);
-    cvReleaseMat(&mat1);
-    send_message("postprocessed_image", image, image_size);
+    if (e->image_size == 0 || !e->has_dets)
+        return;
+
+    uint32_t drawn = e->frame_id;
+    draw_and_send(e);
+    entry_clear(e);
 
-    free(dets->detections);
-    free(dets);
-    free(anns);
-    image = NULL;
-    anns = NULL;
-    image_size = 0;
-    anns_size = 0;
+    // Frames are published in order, so earlier frames still waiting had
+    // no detections published and never will.
+    if (drawn == 0)
+        return;
+    for (int i = 0; i < JOIN_RING_SIZE; ++i) {
+        if (entry_pending(&ring[i]) && ring[i].frame_id != 0 &&
+            frame_before(ring[i].frame_id, drawn))
+            entry_clear(&ring[i]);
+    }
 }
 
 int
@@ -153,5 +392,8 @@ main(int argc, const char *argv[])
             break;
         }
     }
+    for (int i = 0; i < JOIN_RING_SIZE; ++i)
+        free(ring[i].image);
+    class_labels_free();
     return 0;
 }
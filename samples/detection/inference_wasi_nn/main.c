@@ -10,8 +10,15 @@
 #include <unistd.h>
 
 #include "evp/sdk.h"
+#include "frame_meta.h"
+#include "image_convert.h"
 #include "logger.h"
+#include "model_cache.h"
+#include "model_file.h"
 #include "output_tensor_utils.hpp"
+#include "parson.h"
+#include "tensor_ops.h"
+#include "tflite_info.h"
 #include "wasi_nn.h"
 #include "wasi_nn_types.h"
 
@@ -20,34 +27,186 @@
 /* Topic name definition */
 #define OUTPUT_TOPIC  "output_tensor"
 #define REQUEST_TOPIC "give_input_tensor"
+// State topic reporting which model serves frames and which is loading
+#define STATE_TOPIC "model"
 
-#define WIDTH  300
-#define HEIGHT 300
-
+// Set by the "config" RPC, taken by the loader once it is idle
 static char *model_url = NULL;
+// Being downloaded and loaded
+static char *loading_url = NULL;
 static char *model_file = NULL;
-static bool downloaded_model = false;
 
 #define EPSILON                1e-8
 #define MAX_OUTPUT_TENSOR_SIZE 1000000
-#define MAX_MODEL_SIZE         85000000
 #define MAX_OUTPUT_TENSORS     4
 
 #define DEVICE cpu
 
+// Models kept in the workspace across restarts
+#define MODEL_CACHE_ENTRIES 2
+// Downloads of a model tried before it is given up, and the wait between
+// two of them
+#define MODEL_DOWNLOAD_ATTEMPTS 3
+#define MODEL_RETRY_MSEC        2000
+
+// Frames the source may have in flight towards this module. One is enough
+// for overlap: the source captures and converts the next frame while
+// inference runs, and holds it until the credit comes back.
+#define PIPELINE_CREDITS 1
+
+// Largest number of frames run through the model at once
+#define MAX_BATCH 8
+// How long the first frame of a batch waits for the others by default
+#define BATCH_DEADLINE_MSEC 50
+
+// Input size fed to models whose input tensor is not an RGB image
+#define DEFAULT_INPUT_SIZE 300
+
+// Crops of one frame run through the second stage of a cascade, at most
+#define MAX_CROPS MAX_BATCH
+// Class ids the cascade can select
+#define CASCADE_MAX_CLASSES 256
+// Detections cropped by default
+#define CASCADE_SCORE_THRESHOLD 0.5f
+// Order of the outputs of the TFLite SSD postprocess op, as the PPL reads
+// them
+#define SSD_OUTPUT_SCORES  0
+#define SSD_OUTPUT_BOXES   1
+#define SSD_OUTPUT_COUNT   2
+#define SSD_OUTPUT_CLASSES 3
+#define SSD_NUM_OUTPUTS    4
+
 struct timeval start, end;
 double total;
-static int input_size = HEIGHT * WIDTH * 3;
 
+// A loaded model with its own execution context and buffers. A new model
+// is loaded into the idle slot while the active one keeps serving.
+struct model {
+    char *url;
+    graph_execution_context gec;
+
+    // Model input size, read from its input tensor when it is loaded. The
+    // source is asked for frames of this size.
+    uint32_t input_width;
+    uint32_t input_height;
+    int input_size;
+
+    // How frames are fed to the model, decided from its input tensor at
+    // load time. Quantized models take the pixel bytes as they are, shifted
+    // by 128 for int8 inputs, and skip the float32 tensor entirely.
+    tensor_type input_type;
+    bool input_signed;
+    void *input_buf;
+
+    // Frames per compute. Models with an open batch dimension take the size
+    // the "batch" RPC asks for. Models with a fixed batch dimension impose
+    // theirs, and batches the deadline cuts short are padded to it.
+    uint32_t batch_size;
+    bool input_dynamic_batch;
+    // Fixed batch dimension of the model, 0 when it is open
+    uint32_t model_batch;
+    // Frames gathered for the next compute, copied out of their messages
+    uint8_t *frames;
+
+    // Model outputs, each sent as its own tensor, with the shape of a
+    // single frame. Quantized outputs go out in their 8-bit form;
+    // output_scratch receives the floats wasi-nn returns for them, and for
+    // whole batches.
+    tflite_tensor_info_t output_info[MAX_OUTPUT_TENSORS];
+    uint32_t output_sizes[MAX_OUTPUT_TENSORS];
+    uint32_t num_outputs;
+    float *output_scratch;
+};
+
+static struct model models[2];
+// Serving frames, NULL until the first model is loaded
+static struct model *active = NULL;
+// Replaced by `active`, still serving the frames of its input size that
+// were in flight at the switch
+static struct model *previous = NULL;
+
+// Second stage of a cascade, run on crops of the detections of the active
+// model, cut from the frame it ran on. See the "cascade" RPC.
+struct cascade {
+    // Loaded once model.url is set
+    struct model model;
+    float score_threshold;
+    // Classes whose detections are cropped, all of them if all_classes
+    bool all_classes;
+    bool classes[CASCADE_MAX_CLASSES];
+    uint32_t max_crops;
+    // Fraction of the box size added on each side
+    float margin;
+    image_fit_t fit;
+    // Detector outputs of the last compute, read back from the runtime
+    float *detections;
+    size_t detections_size;
+    // Second stage outputs for the crops of one frame, output after output
+    float *results;
+    // One output of one second stage compute
+    float *chunk;
+};
+
+// Crop of a frame, in pixels of the detector input
+struct crop {
+    // Detection it was cut for
+    uint32_t index;
+    uint32_t x;
+    uint32_t y;
+    uint32_t width;
+    uint32_t height;
+};
+
+static struct cascade cascade = {
+    .score_threshold = CASCADE_SCORE_THRESHOLD,
+    .all_classes = true,
+    .max_crops = MAX_CROPS,
+    .fit = IMAGE_FIT_STRETCH,
+};
+// Set by the "cascade" RPC, loaded after any pending first stage model
+static char *cascade_url = NULL;
+// Whether loading_url is the second stage
+static bool loading_cascade = false;
+
+static uint32_t batch_request = 1;
+static bool batch_request_changed = false;
+static uint32_t batch_deadline_ms = BATCH_DEADLINE_MSEC;
+// Frames gathered for the active model, in arrival order, with those the
+// stride skipped in between marked in batch_skipped. Only the batch_count
+// gathered ones are in active->frames.
+#define MAX_PENDING (MAX_BATCH * 4)
+static frame_meta_t batch_meta[MAX_PENDING];
+static bool batch_skipped[MAX_PENDING];
+static uint32_t batch_pending = 0;
+static uint32_t batch_count = 0;
+static uint64_t batch_started_ms = 0;
+
+// Empty OutputTensors of skipped frames, sent from small buffers of their
+// own so they hold no output buffer until their send completes. Words
+// keep the tables aligned for their 64-bit timestamp.
+#define SKIPPED_OUTPUT_SIZE 128
+struct skipped_output {
+    bool in_use;
+    uint64_t data[SKIPPED_OUTPUT_SIZE / sizeof(uint64_t)];
+};
+static struct skipped_output skipped_outputs[MAX_PENDING];
+
+// Only one frame in `stride` of each camera runs through the model
+static uint32_t stride = 1;
+static uint32_t stride_count[MAX_STREAMS];
+
+// Loading of the next model; the active one keeps serving meanwhile
 typedef enum {
-    DOWNLOAD_MODEL = 0,
+    IDLE = 0,
+    DOWNLOAD_MODEL,
+    // Waiting to download again after a failed download
+    RETRY_DOWNLOAD,
     LOAD_MODEL,
-    GET_DATA,
-    RUN_MODEL
 } STATE_MODEL;
 
-static STATE_MODEL state = DOWNLOAD_MODEL;
-static graph_execution_context gec;
+static STATE_MODEL state = IDLE;
+static uint32_t download_attempts = 0;
+static uint64_t retry_at_ms = 0;
 
 static const char *module_name = "INFERENCE";
 static struct EVP_client *h;
@@ -56,6 +215,10 @@ static char *g_publish_to;
 struct send_message_cb_data {
     char *topic;
     char *payload;
+    // Set when the payload lives in an output flatbuffer
+    output_tensor_fb_t *fb;
+    // Set when the payload lives in a skipped frame buffer
+    struct skipped_output *skipped;
 };
 
 typedef struct {
@@ -70,6 +233,79 @@ typedef struct {
     char *blob_url;
 } blob_cb_data_t;
 
+static void
+state_sent_cb(EVP_STATE_CALLBACK_REASON reason, void *userData)
+{
+    json_free_serialized_string(userData);
+}
+
+// Report `status` ("loading", "ready" or "failed") on the state topic,
+// with the model serving frames and the one being loaded.
+static void
+report_model_state(const char *status)
+{
+    JSON_Value *value = json_value_init_object();
+    JSON_Object *object = json_value_get_object(value);
+    json_object_set_string(object, "status", status);
+    if (active != NULL)
+        json_object_set_string(object, "model", active->url);
+    else
+        json_object_set_null(object, "model");
+    if (cascade.model.url != NULL)
+        json_object_set_string(object, "cascade", cascade.model.url);
+    else
+        json_object_set_null(object, "cascade");
+    if (loading_url != NULL)
+        json_object_set_string(object, "loading", loading_url);
+    else
+        json_object_set_null(object, "loading");
+    char *text = json_serialize_to_string(value);
+    json_value_free(value);
+    if (text == NULL)
+        return;
+
+    LOG_INFO("Model state: %s", text);
+    EVP_RESULT result = EVP_sendState(h, STATE_TOPIC, text, strlen(text),
+                                      state_sent_cb, text);
+    if (result != EVP_OK) {
+        LOG_WARN("%s: EVP_sendState failed: %d", module_name, result);
+        // No callback will come.
+        json_free_serialized_string(text);
+    }
+}
+
+// The model being loaded is given up; the active one keeps serving.
+static void
+load_failed(void)
+{
+    report_model_state("failed");
+    free(loading_url);
+    loading_url = NULL;
+    state = IDLE;
+}
+
+static uint64_t
+now_ms(void)
+{
+    struct timeval tv;
+    gettimeofday(&tv, NULL);
+    return (uint64_t)tv.tv_sec * 1000 + tv.tv_usec / 1000;
+}
+
+// Download the model again after a while, or give it up after
+// MODEL_DOWNLOAD_ATTEMPTS tries.
+static void
+download_failed(void)
+{
+    if (download_attempts >= MODEL_DOWNLOAD_ATTEMPTS) {
+        load_failed();
+        return;
+    }
+    LOG_INFO("Retrying the download in %u ms", MODEL_RETRY_MSEC);
+    retry_at_ms = now_ms() + MODEL_RETRY_MSEC;
+    state = RETRY_DOWNLOAD;
+}
+
 static void
 blob_cb(EVP_BLOB_CALLBACK_REASON reason, const void *vp, void *userData)
 {
@@ -85,7 +321,16 @@ blob_cb(EVP_BLOB_CALLBACK_REASON reason, const void *vp, void *userData)
         LOG_INFO("result=%u "
                  "http_status=%u error=%d",
                  result->result, result->http_status, result->error);
-        state = LOAD_MODEL;
+        if (result->result != EVP_BLOB_RESULT_SUCCESS) {
+            LOG_ERR("Model download failed");
+            download_failed();
+            break;
+        }
+        model_file = model_cache_insert(cb_data->blob_url);
+        if (model_file != NULL)
+            state = LOAD_MODEL;
+        else
+            load_failed();
         break;
     case EVP_BLOB_CALLBACK_REASON_EXIT:
         assert(vp == NULL);
@@ -96,6 +341,7 @@ blob_cb(EVP_BLOB_CALLBACK_REASON reason, const void *vp, void *userData)
 
     free(cb_data->blob_url);
     cb_data->blob_url = NULL;
+    module_vars->download = NULL;
     free(module_vars->filename);
     module_vars->filename = NULL;
     module_vars->localStore.filename = NULL;
@@ -108,13 +354,20 @@ send_message_cb(EVP_MESSAGE_SENT_CALLBACK_REASON reason, void *userData)
     assert(d != NULL);
     assert(d->topic != NULL);
     free(d->topic);
-    if (d->payload)
+    if (d->fb)
+        output_tensor_fb_release(d->fb);
+    else if (d->skipped)
+        d->skipped->in_use = false;
+    else if (d->payload)
         free(d->payload);
     free(d);
 }
 
+// Send `buf`, which lives in `fb` or `skipped` when they are set and is
+// freed otherwise once sent.
 static void
-send_message(char *topic, char *buf, int size)
+send_message_from(char *topic, char *buf, int size, output_tensor_fb_t *fb,
+                  struct skipped_output *skipped)
 {
     LOG_DBG("entering send_inference");
     struct send_message_cb_data *d = malloc(sizeof(*d));
@@ -122,83 +375,899 @@ send_message(char *topic, char *buf, int size)
 
     d->topic = strdup(topic);
     d->payload = buf;
+    d->fb = fb;
+    d->skipped = skipped;
     EVP_RESULT result =
         EVP_sendMessage(h, d->topic, d->payload, size, send_message_cb, d);
 
     if (EVP_OK != result) {
         LOG_DBG("%s %s %d: calling EVP_sendMessage", module_name, d->topic,
                 result);
+        // No callback will come; give the buffer back now.
+        send_message_cb(EVP_MESSAGE_SENT_CALLBACK_REASON_ERROR, d);
+        return;
     }
     static int outs = 1;
     LOG_DBG("%s: OUTPUT (%d) (topic=%s, size=%d)", module_name, outs++,
              d->topic, (int)size);
 }
 
-static char *
-run_inference(char *image_buf, int image_buf_size, uint32_t *out_size)
+static void
+send_message_fb(char *topic, char *buf, int size, output_tensor_fb_t *fb)
+{
+    send_message_from(topic, buf, size, fb, NULL);
+}
+
+static void
+send_message(char *topic, char *buf, int size)
 {
-    uint32_t dim[] = {1, HEIGHT, WIDTH, 3};
+    send_message_from(topic, buf, size, NULL, NULL);
+}
+
+// Grant the source `n` more frames of the active model input size on the
+// request topic.
+static void
+send_credits(uint32_t n)
+{
+    char *buf = NULL;
+    int len = asprintf(&buf, "%u %ux%u", n, active->input_width,
+                       active->input_height);
+    assert(len > 0);
+    send_message(REQUEST_TOPIC, buf, len);
+}
+
+static bool
+is_quantized(const tflite_tensor_info_t *info)
+{
+    return (info->type == TFLITE_UINT8 || info->type == TFLITE_INT8) &&
+           info->scale > 0;
+}
+
+// Frames in the input tensor of a compute
+static uint32_t
+batch_slots(const struct model *m)
+{
+    return m->model_batch != 0 ? m->model_batch : m->batch_size;
+}
+
+static void
+setup_batch(struct model *m, const tflite_tensor_info_t *info)
+{
+    uint32_t first = info->num_dims == 4 ? info->dims[0] : 1;
+    m->input_dynamic_batch = info->dynamic_batch;
+    m->model_batch = first > 1 && !info->dynamic_batch ? first : 0;
+    if (m->model_batch != 0) {
+        m->batch_size =
+            m->model_batch < MAX_BATCH ? m->model_batch : MAX_BATCH;
+    } else if (m->input_dynamic_batch) {
+        m->batch_size = batch_request;
+    } else {
+        if (batch_request > 1)
+            LOG_WARN("The model takes one frame at a time");
+        m->batch_size = 1;
+    }
+    LOG_INFO("Batches of %u frames in %u slots", m->batch_size,
+             batch_slots(m));
+}
+
+// Buffers holding a whole batch of input frames
+static void
+alloc_input_buffers(struct model *m)
+{
+    size_t samples = (size_t)batch_slots(m) * m->input_size;
+    free(m->frames);
+    m->frames = malloc(samples);
+    free(m->input_buf);
+    m->input_buf = NULL;
+    if (m->input_type == fp32)
+        m->input_buf = malloc(samples * sizeof(float));
+    else if (m->input_signed)
+        m->input_buf = malloc(samples);
+    assert(m->frames != NULL &&
+           (m->input_buf != NULL || (m->input_type == up8 &&
+                                     !m->input_signed)));
+}
+
+// Room for the largest output of a whole batch, for the outputs that do
+// not go straight into the flatbuffer
+static void
+alloc_output_scratch(struct model *m)
+{
+    uint32_t slots = batch_slots(m);
+    uint32_t scratch_size = 0;
+    for (uint32_t i = 0; i < m->num_outputs; ++i) {
+        if ((slots > 1 || is_quantized(&m->output_info[i])) &&
+            m->output_sizes[i] > scratch_size)
+            scratch_size = m->output_sizes[i];
+    }
+    free(m->output_scratch);
+    m->output_scratch = NULL;
+    if (scratch_size > 0) {
+        m->output_scratch =
+            malloc((size_t)scratch_size * slots * sizeof(float));
+        assert(m->output_scratch != NULL);
+    }
+}
+
+// Free what `m` holds and empty the slot. wasi-nn has no call to unload a
+// graph, so the graph and its context stay in the runtime.
+static void
+release_model(struct model *m)
+{
+    free(m->url);
+    free(m->frames);
+    free(m->input_buf);
+    free(m->output_scratch);
+    memset(m, 0, sizeof(*m));
+}
+
+static void
+retire_previous(void)
+{
+    LOG_INFO("Model %s retired", previous->url);
+    release_model(previous);
+    previous = NULL;
+}
+
+static void
+setup_input(struct model *m, const uint8_t *model, size_t size)
+{
+    m->input_width = DEFAULT_INPUT_SIZE;
+    m->input_height = DEFAULT_INPUT_SIZE;
+    m->input_size = DEFAULT_INPUT_SIZE * DEFAULT_INPUT_SIZE * 3;
+    m->model_batch = 0;
+    m->input_dynamic_batch = false;
+    m->batch_size = 1;
+
+    tflite_tensor_info_t info = {0};
+    if (tflite_input_info(model, size, 0, &info) != 0) {
+        LOG_WARN("Could not read the model input tensor, assuming float32");
+        info.type = TFLITE_FLOAT32;
+    } else if (info.num_dims == 4 && info.dims[3] == 3 && info.dims[1] > 0 &&
+               info.dims[2] > 0) {
+        // NHWC
+        m->input_height = info.dims[1];
+        m->input_width = info.dims[2];
+        m->input_size = m->input_width * m->input_height * 3;
+        setup_batch(m, &info);
+    } else {
+        LOG_WARN("Model input is not an RGB image, feeding %ux%u frames",
+                 m->input_width, m->input_height);
+    }
+    LOG_INFO("Model input size %ux%u", m->input_width, m->input_height);
+
+    // Quantized models are exported to take the camera pixels as they are,
+    // whatever range their scale and zero point map them to.
+    m->input_type = fp32;
+    m->input_signed = false;
+    if (info.type == TFLITE_UINT8 || info.type == TFLITE_INT8) {
+        m->input_type = up8;
+        m->input_signed = info.type == TFLITE_INT8;
+    }
+    alloc_input_buffers(m);
+    LOG_INFO("Model input type %d (scale=%f zero_point=%d), feeding %s",
+             info.type, info.scale, info.zero_point,
+             m->input_type == fp32 ? "float32"
+             : m->input_signed     ? "int8 pixels - 128"
+                                   : "uint8 pixels");
+}
+
+// Turn `count` RGB frames into the input buffer of `m`.
+static const uint8_t *
+prepare_input(struct model *m, const uint8_t *frames, uint32_t count)
+{
+    uint32_t n = count * m->input_size;
+    if (m->input_type == fp32) {
+        tensor_normalize_u8(frames, m->input_buf, n);
+        return m->input_buf;
+    }
+    if (!m->input_signed)
+        return frames;
+    tensor_u8_to_i8(frames, m->input_buf, n);
+    return m->input_buf;
+}
+
+// The runtime may not accept uint8 input even for a quantized model; fall
+// back to feeding float32 from then on.
+static void
+fallback_to_fp32(struct model *m)
+{
+    LOG_WARN("uint8 input rejected by the runtime, falling back to float32");
+    free(m->input_buf);
+    m->input_buf =
+        malloc((size_t)batch_slots(m) * m->input_size * sizeof(float));
+    assert(m->input_buf != NULL);
+    m->input_type = fp32;
+    m->input_signed = false;
+}
+
+static void
+setup_outputs(struct model *m, const uint8_t *model, size_t size)
+{
+    for (m->num_outputs = 0; m->num_outputs < MAX_OUTPUT_TENSORS;
+         ++m->num_outputs) {
+        uint32_t i = m->num_outputs;
+        tflite_tensor_info_t *info = &m->output_info[i];
+        if (tflite_output_info(model, size, i, info) != 0)
+            break;
+        // Sent per frame
+        if (m->model_batch != 0 && info->num_dims > 0 &&
+            info->dims[0] == m->model_batch)
+            info->dims[0] = 1;
+        m->output_sizes[i] = tflite_num_elements(info);
+        LOG_DBG("Output %u: type %d, %u elements", i, info->type,
+                m->output_sizes[i]);
+    }
+    alloc_output_scratch(m);
+}
+
+// Fallback when the output shapes could not be read from the model: ask the
+// runtime once with a large scratch buffer, after a compute of `slots`
+// frames.
+static void
+probe_output_sizes(struct model *m, uint32_t slots)
+{
+    float *scratch = malloc(sizeof(float) * MAX_OUTPUT_TENSOR_SIZE);
+    assert(scratch != NULL);
+
+    uint32_t offset = 0;
+    for (m->num_outputs = 0; m->num_outputs < MAX_OUTPUT_TENSORS;
+         ++m->num_outputs) {
+        uint32_t i = m->num_outputs;
+        uint32_t size = MAX_OUTPUT_TENSOR_SIZE - offset;
+        if (get_output(m->gec, i, (uint8_t *)&scratch[offset], &size) !=
+            success)
+            break;
+        // Shape unknown: send it as a flat float vector.
+        tflite_tensor_info_t *info = &m->output_info[i];
+        memset(info, 0, sizeof(*info));
+        info->type = TFLITE_FLOAT32;
+        info->num_dims = 1;
+        info->dims[0] = size / slots;
+        m->output_sizes[i] = size / slots;
+        offset += size;
+    }
+    free(scratch);
+    alloc_output_scratch(m);
+}
+
+// Feed `count` frames as one input tensor of `m`.
+static error
+set_batch_input(struct model *m, const uint8_t *frames, uint32_t count)
+{
+    uint32_t dim[] = {count, m->input_height, m->input_width, 3};
 
     tensor_dimensions dims;
     dims.size = 4;
-    dims.buf = (uint32_t *)malloc(dims.size * sizeof(uint32_t));
+    dims.buf = dim;
 
     tensor tensor;
     tensor.dimensions = &dims;
-    for (int i = 0; i < tensor.dimensions->size; ++i)
-        tensor.dimensions->buf[i] = dim[i];
-    tensor.type = fp32;
-    tensor.data = (uint8_t *)image_buf;
-    error err = set_input(gec, 0, &tensor);
+    tensor.type = m->input_type;
+    tensor.data = (uint8_t *)prepare_input(m, frames, count);
+    error err = set_input(m->gec, 0, &tensor);
+    // An open batch dimension the runtime cannot resize fails the same way:
+    // that is left to the caller.
+    if (err != success && m->input_type != fp32 &&
+        (count == 1 || m->model_batch != 0)) {
+        fallback_to_fp32(m);
+        tensor.type = m->input_type;
+        tensor.data = (uint8_t *)prepare_input(m, frames, count);
+        err = set_input(m->gec, 0, &tensor);
+    }
+    if (err != success && (count == 1 || m->model_batch != 0))
+        LOG_ERR("set_input failed: %d", err);
+    return err;
+}
 
-    free(dims.buf);
+static void
+run_compute(struct model *m)
+{
     struct timeval start, end;
     gettimeofday(&start, NULL);
 
-    compute(gec);
+    compute(m->gec);
 
     gettimeofday(&end, NULL);
 
     float seconds = end.tv_sec - start.tv_sec +
                     (float)(end.tv_usec - start.tv_usec) / 1000000.0;
     LOG_DBG("Running model time is %fs", seconds);
+}
 
-    float *output_tensor =
-        (float *)malloc(sizeof(float) * MAX_OUTPUT_TENSOR_SIZE);
+// Fill the slots of m->frames past the first `count` with copies of the
+// last frame, for models with a fixed batch dimension.
+static void
+pad_frames(struct model *m, uint32_t count, uint32_t slots)
+{
+    for (uint32_t k = count; k < slots; ++k)
+        memcpy(m->frames + (size_t)k * m->input_size,
+               m->frames + (size_t)(count - 1) * m->input_size,
+               m->input_size);
+}
 
-    uint32_t offset = 0;
-    for (int i = 0; i < MAX_OUTPUT_TENSORS; ++i) {
-        *out_size = MAX_OUTPUT_TENSOR_SIZE - *out_size;
-        error err =
-            get_output(gec, i, (uint8_t *)&output_tensor[offset], out_size);
-        if (err != success)
-            break;
-        offset += *out_size;
+// Size the second stage buffers for `cascade.max_crops` crops per frame.
+static void
+cascade_setup_buffers(void)
+{
+    struct model *m = &cascade.model;
+    if (m->input_dynamic_batch)
+        m->batch_size = cascade.max_crops;
+    alloc_input_buffers(m);
+
+    size_t total = 0, largest = 0;
+    for (uint32_t j = 0; j < m->num_outputs; ++j) {
+        total += m->output_sizes[j];
+        if (m->output_sizes[j] > largest)
+            largest = m->output_sizes[j];
+    }
+    free(cascade.results);
+    cascade.results = malloc(total * cascade.max_crops * sizeof(float));
+    free(cascade.chunk);
+    cascade.chunk = malloc(largest * batch_slots(m) * sizeof(float));
+    assert(cascade.results != NULL && cascade.chunk != NULL);
+    LOG_INFO("Cascade: up to %u crops per frame, %u per compute",
+             cascade.max_crops, m->batch_size);
+}
+
+// Results of second stage output `j`, `max_crops` crops long
+static float *
+cascade_result(uint32_t j)
+{
+    const struct model *m = &cascade.model;
+    float *p = cascade.results;
+    for (uint32_t i = 0; i < j; ++i)
+        p += (size_t)m->output_sizes[i] * cascade.max_crops;
+    return p;
+}
+
+// The second stage crops the boxes of the SSD postprocess outputs, so a
+// detector with raw outputs, decoded in the PPL, cannot feed it. Models
+// whose outputs are not known until they run are let through.
+static bool
+cascade_fits(const struct model *det)
+{
+    return det->num_outputs == 0 || det->num_outputs >= SSD_NUM_OUTPUTS;
+}
+
+// Turn the cascade off if the active detector cannot feed it. Returns true
+// if it was on.
+static bool
+cascade_drop_unfit(void)
+{
+    if (cascade.model.url == NULL || active == NULL || cascade_fits(active))
+        return false;
+    LOG_ERR("Cascade off: the detector has %u outputs, not the %u of the "
+            "SSD postprocess op",
+            active->num_outputs, SSD_NUM_OUTPUTS);
+    release_model(&cascade.model);
+    return true;
+}
+
+// Read the detector outputs of the last compute of `m` back from the
+// runtime. Returns false if they are not the SSD postprocess outputs,
+// as for a previous detector still draining.
+static bool
+cascade_read_detections(struct model *m, uint32_t slots)
+{
+    if (m->num_outputs < SSD_NUM_OUTPUTS)
+        return false;
+    size_t total = 0;
+    for (uint32_t i = 0; i < SSD_NUM_OUTPUTS; ++i)
+        total += (size_t)m->output_sizes[i] * slots;
+    if (total > cascade.detections_size) {
+        free(cascade.detections);
+        cascade.detections = malloc(total * sizeof(float));
+        assert(cascade.detections != NULL);
+        cascade.detections_size = total;
     }
-    *out_size = offset;
 
-    char *fb = creat_output_tensor_fb(output_tensor, *out_size, out_size);
-    free(output_tensor);
-    LOG_DBG("exiting run_inference");
-    return fb;
+    float *p = cascade.detections;
+    for (uint32_t i = 0; i < SSD_NUM_OUTPUTS; ++i) {
+        uint32_t n = m->output_sizes[i] * slots;
+        uint32_t size = n;
+        error err = get_output(m->gec, i, (uint8_t *)p, &size);
+        if (err != success || size != n) {
+            LOG_WARN("Cascade: output %u: error %d, %u of %u elements", i,
+                     err, size, n);
+            return false;
+        }
+        p += n;
+    }
+    return true;
+}
+
+// Detector output `i` of frame `k` of a compute over `slots` frames
+static const float *
+detection_output(const struct model *m, uint32_t slots, uint32_t i,
+                 uint32_t k)
+{
+    const float *p = cascade.detections;
+    for (uint32_t j = 0; j < i; ++j)
+        p += (size_t)m->output_sizes[j] * slots;
+    return p + (size_t)k * m->output_sizes[i];
+}
+
+// Pick the detections of frame `k` to crop, in score order, and turn their
+// boxes into pixels of the detector input.
+static uint32_t
+cascade_select(const struct model *m, uint32_t slots, uint32_t k,
+               struct crop *crops)
+{
+    const float *scores = detection_output(m, slots, SSD_OUTPUT_SCORES, k);
+    const float *boxes = detection_output(m, slots, SSD_OUTPUT_BOXES, k);
+    const float *classes = detection_output(m, slots, SSD_OUTPUT_CLASSES, k);
+    float detected = detection_output(m, slots, SSD_OUTPUT_COUNT, k)[0];
+
+    uint32_t n = detected > 0 ? (uint32_t)detected : 0;
+    uint32_t available = m->output_sizes[SSD_OUTPUT_BOXES] / 4;
+    if (m->output_sizes[SSD_OUTPUT_SCORES] < available)
+        available = m->output_sizes[SSD_OUTPUT_SCORES];
+    if (m->output_sizes[SSD_OUTPUT_CLASSES] < available)
+        available = m->output_sizes[SSD_OUTPUT_CLASSES];
+    if (n > available)
+        n = available;
+
+    uint32_t count = 0;
+    for (uint32_t i = 0; i < n && count < cascade.max_crops; ++i) {
+        uint32_t cls = classes[i] > 0 ? (uint32_t)classes[i] : 0;
+        if (scores[i] < cascade.score_threshold ||
+            (!cascade.all_classes &&
+             (cls >= CASCADE_MAX_CLASSES || !cascade.classes[cls])))
+            continue;
+
+        // (y_min, x_min, y_max, x_max), normalized
+        const float *b = &boxes[i * 4];
+        float dy = (b[2] - b[0]) * cascade.margin;
+        float dx = (b[3] - b[1]) * cascade.margin;
+        float y0 = fminf(fmaxf(b[0] - dy, 0), 1);
+        float x0 = fminf(fmaxf(b[1] - dx, 0), 1);
+        float y1 = fminf(fmaxf(b[2] + dy, 0), 1);
+        float x1 = fminf(fmaxf(b[3] + dx, 0), 1);
+
+        struct crop *c = &crops[count];
+        c->index = i;
+        c->x = (uint32_t)(x0 * m->input_width);
+        c->y = (uint32_t)(y0 * m->input_height);
+        uint32_t right = (uint32_t)ceilf(x1 * m->input_width);
+        uint32_t bottom = (uint32_t)ceilf(y1 * m->input_height);
+        if (c->x >= m->input_width || c->y >= m->input_height)
+            continue;
+        c->width = right > c->x ? right - c->x : 1;
+        c->height = bottom > c->y ? bottom - c->y : 1;
+        count++;
+    }
+    return count;
+}
+
+// Append the crops of a frame and their second stage outputs to `fb`: a
+// tensor of the detection index of each crop, then each output with the
+// crops as its first dimension.
+static void
+cascade_append(output_tensor_fb_t *fb, const struct crop *crops,
+               uint32_t count)
+{
+    const struct model *m = &cascade.model;
+    float *index =
+        output_tensor_fb_begin_tensor(fb, OUTPUT_TENSOR_FLOAT32, count);
+    for (uint32_t c = 0; c < count; ++c)
+        index[c] = crops[c].index;
+    output_tensor_fb_end_tensor(fb, &count, 1, 0, 0);
+
+    for (uint32_t j = 0; j < m->num_outputs; ++j) {
+        const tflite_tensor_info_t *info = &m->output_info[j];
+        uint32_t n = m->output_sizes[j];
+        uint32_t shape[TFLITE_MAX_DIMS] = {count, n};
+        uint32_t num_dims = 2;
+        if (info->num_dims > 0 && info->dims[0] == 1) {
+            memcpy(shape, info->dims, info->num_dims * sizeof(shape[0]));
+            shape[0] = count;
+            num_dims = info->num_dims;
+        }
+
+        const float *data = cascade_result(j);
+        bool quantized = is_quantized(info);
+        if (quantized) {
+            bool is_signed = info->type == TFLITE_INT8;
+            uint8_t *q = output_tensor_fb_begin_tensor(
+                fb, is_signed ? OUTPUT_TENSOR_INT8 : OUTPUT_TENSOR_UINT8,
+                count * n);
+            tensor_quantize_f32(data, q, count * n, info->scale,
+                                info->zero_point, is_signed);
+        } else {
+            float *f = output_tensor_fb_begin_tensor(
+                fb, OUTPUT_TENSOR_FLOAT32, count * n);
+            memcpy(f, data, (size_t)count * n * sizeof(float));
+        }
+        output_tensor_fb_end_tensor(fb, shape, num_dims,
+                                    quantized ? info->scale : 0,
+                                    info->zero_point);
+    }
+}
+
+// Run the second stage on the detections of frame `k` of the last compute
+// of `det`, whose pixels are `frame`, batching the crops, and add the
+// results to the frame's OutputTensor.
+static void
+cascade_run(struct model *det, const uint8_t *frame, uint32_t slots,
+            uint32_t k, output_tensor_fb_t *fb)
+{
+    struct model *m = &cascade.model;
+    struct crop crops[MAX_CROPS];
+    uint32_t count = cascade_select(det, slots, k, crops);
+
+    uint32_t first = 0;
+    while (first < count) {
+        uint32_t n = count - first;
+        if (n > m->batch_size)
+            n = m->batch_size;
+        for (uint32_t c = 0; c < n; ++c) {
+            const struct crop *crop = &crops[first + c];
+            image_src_t src = {
+                .data = frame + ((size_t)crop->y * det->input_width +
+                                 crop->x) * 3,
+                .width = crop->width,
+                .height = crop->height,
+                .stride = det->input_width * 3,
+                .format = IMAGE_FORMAT_RGB24,
+            };
+            image_convert_rgb24_fit(&src,
+                                    m->frames + (size_t)c * m->input_size,
+                                    m->input_width, m->input_height,
+                                    cascade.fit);
+        }
+        uint32_t s = m->model_batch != 0 ? m->model_batch : n;
+        pad_frames(m, n, s);
+
+        if (set_batch_input(m, m->frames, s) != success) {
+            if (s > 1 && m->model_batch == 0) {
+                LOG_WARN("Crop batches rejected by the runtime, running "
+                         "single crops");
+                m->batch_size = 1;
+                continue;
+            }
+            for (uint32_t j = 0; j < m->num_outputs; ++j)
+                memset(cascade_result(j) + (size_t)first * m->output_sizes[j],
+                       0, (size_t)n * m->output_sizes[j] * sizeof(float));
+            first += n;
+            continue;
+        }
+        run_compute(m);
+
+        for (uint32_t j = 0; j < m->num_outputs; ++j) {
+            uint32_t size = m->output_sizes[j] * s;
+            error err = get_output(m->gec, j, (uint8_t *)cascade.chunk,
+                                   &size);
+            if (err != success || size != m->output_sizes[j] * s) {
+                LOG_WARN("Cascade output %u: error %d, %u of %u elements",
+                         j, err, size, m->output_sizes[j] * s);
+                memset(cascade.chunk, 0,
+                       (size_t)m->output_sizes[j] * s * sizeof(float));
+            }
+            memcpy(cascade_result(j) + (size_t)first * m->output_sizes[j],
+                   cascade.chunk,
+                   (size_t)n * m->output_sizes[j] * sizeof(float));
+        }
+        first += n;
+    }
+    cascade_append(fb, crops, count);
+}
+
+// Fill `fbs` with one OutputTensor for each of the first `count` frames,
+// split out of the outputs of a compute over `slots` frames. With a
+// cascade, the second stage runs on each of `frames` first and only the
+// fused result is kept. Frames without a free buffer get NULL.
+static void
+build_outputs(struct model *m, const uint8_t *frames, uint32_t count,
+              uint32_t slots, output_tensor_fb_t **fbs)
+{
+    if (m->num_outputs == 0) {
+        probe_output_sizes(m, slots);
+        if (cascade_drop_unfit())
+            report_model_state("ready");
+    }
+
+    uint32_t acquired = 0;
+    for (uint32_t k = 0; k < count; ++k) {
+        fbs[k] = output_tensor_fb_acquire();
+        if (fbs[k] != NULL)
+            acquired++;
+    }
+    if (acquired == 0)
+        return;
+
+    for (uint32_t i = 0; i < m->num_outputs; ++i) {
+        const tflite_tensor_info_t *info = &m->output_info[i];
+        bool quantized = is_quantized(info);
+        uint32_t n = m->output_sizes[i];
+        uint32_t size = n * slots;
+
+        // The output of a single frame is written straight into the
+        // flatbuffer being sent.
+        float *data = m->output_scratch;
+        if (slots == 1 && !quantized)
+            data = output_tensor_fb_begin_tensor(fbs[0],
+                                                 OUTPUT_TENSOR_FLOAT32, n);
+        error err = get_output(m->gec, i, (uint8_t *)data, &size);
+        if (err != success || size != n * slots) {
+            LOG_WARN("Output %u: error %d, %u of %u elements", i, err, size,
+                     n * slots);
+            memset(data, 0, (size_t)n * slots * sizeof(float));
+        }
+
+        for (uint32_t k = 0; k < count; ++k) {
+            output_tensor_fb_t *fb = fbs[k];
+            if (fb == NULL)
+                continue;
+            const float *frame = data + (size_t)k * n;
+            if (quantized) {
+                // wasi-nn hands back dequantized floats; send the 8-bit
+                // values, a quarter of the size.
+                bool is_signed = info->type == TFLITE_INT8;
+                uint8_t *q = output_tensor_fb_begin_tensor(
+                    fb, is_signed ? OUTPUT_TENSOR_INT8 : OUTPUT_TENSOR_UINT8,
+                    n);
+                tensor_quantize_f32(frame, q, n, info->scale,
+                                    info->zero_point, is_signed);
+            } else if (slots > 1) {
+                float *f = output_tensor_fb_begin_tensor(
+                    fb, OUTPUT_TENSOR_FLOAT32, n);
+                memcpy(f, frame, n * sizeof(float));
+            }
+            output_tensor_fb_end_tensor(fb, info->dims, info->num_dims,
+                                        quantized ? info->scale : 0,
+                                        info->zero_point);
+        }
+    }
+
+    bool crops = cascade.model.url != NULL &&
+                 cascade_read_detections(m, slots);
+    for (uint32_t k = 0; k < count; ++k) {
+        if (fbs[k] == NULL)
+            continue;
+        if (crops)
+            cascade_run(m, frames + (size_t)k * m->input_size, slots, k,
+                        fbs[k]);
+    }
+}
+
+// A frame the stride skips: an OutputTensor without tensors, so the
+// tracker predicts its boxes. The table is tiny, so it is sent from one of
+// skipped_outputs rather than holding an output buffer meanwhile.
+static void
+send_skipped(const frame_meta_t *meta)
+{
+    struct skipped_output *so = NULL;
+    for (uint32_t i = 0; i < MAX_PENDING && so == NULL; ++i)
+        if (!skipped_outputs[i].in_use)
+            so = &skipped_outputs[i];
+    output_tensor_fb_t *fb = so != NULL ? output_tensor_fb_acquire() : NULL;
+    if (fb == NULL) {
+        LOG_WARN("No free output buffer, dropping frame %u", meta->frame_id);
+        return;
+    }
+    uint32_t out_size;
+    const uint8_t *out = output_tensor_fb_finish(fb, meta, &out_size);
+    assert(out_size <= SKIPPED_OUTPUT_SIZE);
+    memcpy(so->data, out, out_size);
+    output_tensor_fb_release(fb);
+    so->in_use = true;
+    send_message_from(OUTPUT_TOPIC, (char *)so->data, out_size, NULL, so);
+}
+
+// Send the outputs of `entries` frames in arrival order: the next of `fbs`
+// for a frame that ran, an empty OutputTensor for one marked in `skipped`,
+// which may be NULL.
+static void
+send_in_order(output_tensor_fb_t **fbs, const frame_meta_t *meta,
+              const bool *skipped, uint32_t entries)
+{
+    uint32_t k = 0;
+    for (uint32_t e = 0; e < entries; ++e) {
+        if (skipped != NULL && skipped[e]) {
+            send_skipped(&meta[e]);
+            continue;
+        }
+        output_tensor_fb_t *fb = fbs[k++];
+        if (fb == NULL) {
+            LOG_WARN("No output for frame %u, dropping it", meta[e].frame_id);
+            continue;
+        }
+        uint32_t out_size;
+        const uint8_t *out = output_tensor_fb_finish(fb, &meta[e], &out_size);
+        send_message_fb(OUTPUT_TOPIC, (char *)out, out_size, fb);
+    }
+}
+
+// Run `count` frames, gathered in m->frames, through `m` and build their
+// outputs into `fbs`. Fixed batches are padded with copies of the last
+// frame.
+static error
+run_frames(struct model *m, uint32_t count, output_tensor_fb_t **fbs)
+{
+    uint32_t slots = m->model_batch != 0 ? m->model_batch : count;
+    pad_frames(m, count, slots);
+
+    error err = set_batch_input(m, m->frames, slots);
+    if (err != success)
+        return err;
+    run_compute(m);
+    build_outputs(m, m->frames, count, slots, fbs);
+    return success;
+}
+
+// Run the frames gathered for the active model and send their outputs,
+// along with those of the frames skipped in between.
+static void
+run_batch(void)
+{
+    struct model *m = active;
+    uint32_t count = batch_count, entries = batch_pending;
+    if (entries == 0)
+        return;
+    batch_count = batch_pending = 0;
+
+    output_tensor_fb_t *fbs[MAX_BATCH] = {NULL};
+    if (count > 0 && run_frames(m, count, fbs) != success && count > 1 &&
+        m->model_batch == 0) {
+        // The runtime did not resize the input after all.
+        LOG_WARN("Batches rejected by the runtime, running single frames");
+        m->batch_size = batch_request = 1;
+        for (uint32_t k = 0; k < count; ++k) {
+            const uint8_t *frame = m->frames + (size_t)k * m->input_size;
+            set_batch_input(m, frame, 1);
+            run_compute(m);
+            build_outputs(m, frame, 1, 1, &fbs[k]);
+        }
+    }
+    send_in_order(fbs, batch_meta, batch_skipped, entries);
+
+    gettimeofday(&end, NULL);
+    total = (end.tv_sec - start.tv_sec) +
+            (end.tv_usec - start.tv_usec) / 1000000.0;
+    LOG_DBG("Total time for %u frames: %f seconds", count, total);
+    gettimeofday(&start, NULL);
+}
+
+// Queue the output of a gathered frame, or of a skipped one when
+// `skipped`, behind those before it, so the outputs stay in order without
+// cutting the batch short. A full queue runs the batch early.
+static void
+queue_output(const frame_meta_t *meta, bool skipped)
+{
+    if (batch_pending + 1 >= MAX_PENDING)
+        run_batch();
+    if (skipped && batch_count == 0) {
+        send_skipped(meta);
+        return;
+    }
+    batch_meta[batch_pending] = *meta;
+    batch_skipped[batch_pending++] = skipped;
+}
+
+static bool
+skip_frame(const frame_meta_t *meta)
+{
+    uint32_t *count = &stride_count[meta->stream_id % MAX_STREAMS];
+    bool skip = *count % stride != 0;
+    *count = skip ? *count + 1 : 1;
+    return skip;
+}
+
+// A frame granted before the last switch, run at once through the model
+// it was sized for.
+static void
+run_previous(const void *frame, const frame_meta_t *meta)
+{
+    output_tensor_fb_t *fb = NULL;
+    memcpy(previous->frames, frame, previous->input_size);
+    if (run_frames(previous, 1, &fb) == success)
+        send_in_order(&fb, meta, NULL, 1);
+}
+
+// Take a new batch size from the "batch" RPC, once the frames gathered for
+// the old one have run.
+static void
+apply_batch_request(void)
+{
+    batch_request_changed = false;
+    if (active->model_batch != 0 || !active->input_dynamic_batch) {
+        LOG_WARN("The model sets its batch size of %u", active->batch_size);
+        return;
+    }
+    run_batch();
+    uint32_t old_size = active->batch_size;
+    active->batch_size = batch_request;
+    alloc_input_buffers(active);
+    alloc_output_scratch(active);
+    // One more frame in flight per frame of the batch
+    if (active->batch_size > old_size)
+        send_credits(active->batch_size - old_size);
+    LOG_INFO("Batches of %u frames, %u ms deadline", active->batch_size,
+             batch_deadline_ms);
+}
+
+// Make `m` the active model, between two frames. The frames gathered for
+// the old one run first; those of its size still in flight are run through
+// it as they arrive.
+static void
+switch_model(struct model *m)
+{
+    uint32_t old_credits = 0;
+    if (active != NULL) {
+        run_batch();
+        old_credits = PIPELINE_CREDITS + active->batch_size - 1;
+        previous = active;
+    }
+    active = m;
+    // Frames of the old size would all go to the new model anyway
+    if (previous != NULL && previous->input_width == m->input_width &&
+        previous->input_height == m->input_height)
+        retire_previous();
+
+    // One frame in flight per frame of a batch. Later credits go back with
+    // the new input size.
+    uint32_t credits = PIPELINE_CREDITS + m->batch_size - 1;
+    if (credits > old_credits) {
+        LOG_INFO("Requesting tensors...");
+        send_credits(credits - old_credits);
+    }
+    cascade_drop_unfit();
+    report_model_state("ready");
+}
+
+// Replace the second stage with `m`, which is loaded into a slot of its
+// own so a failed load leaves the current one in place.
+static void
+switch_cascade(struct model *m)
+{
+    if (m->num_outputs == 0) {
+        LOG_ERR("The second stage model does not give its output shapes");
+        release_model(m);
+        load_failed();
+        return;
+    }
+    if (active != NULL && !cascade_fits(active)) {
+        LOG_ERR("The detector has %u outputs, the cascade needs the %u of "
+                "the SSD postprocess op",
+                active->num_outputs, SSD_NUM_OUTPUTS);
+        release_model(m);
+        load_failed();
+        return;
+    }
+    release_model(&cascade.model);
+    cascade.model = *m;
+    cascade_setup_buffers();
+    report_model_state("ready");
 }
 
 static void
 load_model()
 {
+    state = IDLE;
+    struct model staged;
+    struct model *m = &staged;
+    if (loading_cascade) {
+        memset(&staged, 0, sizeof(staged));
+    } else {
+        // The idle slot may still be draining the model before the active
+        // one.
+        m = active == &models[0] ? &models[1] : &models[0];
+        if (m == previous)
+            retire_previous();
+    }
+
     LOG_DBG("Loading model...");
     struct timeval start, end;
     gettimeofday(&start, NULL);
 
-    FILE *pFile = fopen(model_file, "r");
-    assert(pFile != NULL);
-
-    uint8_t *buffer = (uint8_t *)malloc(sizeof(uint8_t) * MAX_MODEL_SIZE);
+    size_t result;
+    uint8_t *buffer = model_file_read(model_file, &result);
     if (buffer == NULL) {
         LOG_ERR("Memory error");
-        exit(2);
+        load_failed();
+        return;
     }
-    size_t result = fread(buffer, 1, MAX_MODEL_SIZE, pFile);
     graph_builder_array arr;
     arr.buf = (graph_builder *)malloc(sizeof(graph_builder));
     arr.size = 1;
@@ -208,43 +1277,166 @@ load_model()
     graph graph;
     error err = load(&arr, tensorflowlite, DEVICE, &graph);
     LOG_DBG("Status of load: %d", err);
+    if (err == success) {
+        setup_input(m, buffer, result);
+        setup_outputs(m, buffer, result);
+    }
 
-    fclose(pFile);
     free(arr.buf);
     free(buffer);
 
-    init_execution_context(graph, &gec);
+    if (err == success)
+        err = init_execution_context(graph, &m->gec);
+    if (err != success) {
+        LOG_ERR("Could not load model %s: %d", loading_url, err);
+        release_model(m);
+        load_failed();
+        return;
+    }
     gettimeofday(&end, NULL);
 
     long seconds = (end.tv_sec - start.tv_sec);
     long micros = ((seconds * 1000000) + end.tv_usec) - (start.tv_usec);
-    state = GET_DATA;
     LOG_DBG("Loading model time is %ld seconds and %ld micros", seconds,
             micros);
+    LOG_DBG("Model size %zu bytes, linear memory %zu bytes", result,
+            model_file_memory_size());
+
+    m->url = loading_url;
+    loading_url = NULL;
+    if (loading_cascade)
+        switch_cascade(m);
+    else
+        switch_model(m);
 }
 
 static void
 download_model()
 {
-    LOG_DBG("Loading model from: %s", model_url);
-    module_vars_t module_vars;
-    module_vars.download = strdup(model_url);
-    module_vars.filename = strdup(model_file);
+    free(model_file);
+    model_file = model_cache_lookup(loading_url);
+    if (model_file != NULL) {
+        LOG_INFO("Using cached model %s", model_file);
+        state = LOAD_MODEL;
+        return;
+    }
+
+    LOG_DBG("Loading model from: %s", loading_url);
+    // The blob operation completes asynchronously, so its state must
+    // outlive this call.
+    static module_vars_t module_vars;
+    static blob_cb_data_t cb_data;
+    module_vars.download = strdup(loading_url);
+    module_vars.filename = strdup(model_cache_download_path());
     module_vars.localStore.filename = module_vars.filename;
     module_vars.localStore.io_cb = NULL;
     module_vars.localStore.blob_len = 0;
 
-    blob_cb_data_t cb_data;
     cb_data.blob_url = module_vars.download;
     cb_data.ctx = &module_vars;
 
     struct EVP_BlobRequestAzureBlob request;
     request.url = module_vars.download;
+    state = DOWNLOAD_MODEL;
+    download_attempts++;
     EVP_RESULT result = EVP_blobOperation(
         h, EVP_BLOB_TYPE_AZURE_BLOB, EVP_BLOB_OP_GET, &request,
         &module_vars.localStore, blob_cb, &cb_data);
+    if (result != EVP_OK) {
+        LOG_ERR("EVP_blobOperation failed: %d", result);
+        // No callback will come.
+        free(module_vars.download);
+        module_vars.download = NULL;
+        free(module_vars.filename);
+        module_vars.filename = NULL;
+        download_failed();
+    }
+}
 
-    assert(result == EVP_OK);
+// Start loading the model last asked for by the "config" RPC, or by the
+// "cascade" RPC when `is_cascade`, taking over `*url`. Requests made
+// meanwhile wait for the load to finish.
+static void
+start_loading(char **url, bool is_cascade)
+{
+    const char *current = is_cascade       ? cascade.model.url
+                          : active != NULL ? active->url
+                                           : NULL;
+    if (current != NULL && strcmp(*url, current) == 0) {
+        LOG_INFO("Model %s is already loaded", *url);
+        free(*url);
+        *url = NULL;
+        return;
+    }
+    loading_url = *url;
+    loading_cascade = is_cascade;
+    *url = NULL;
+    report_model_state("loading");
+    download_attempts = 0;
+    download_model();
+}
+
+// Model the frame was sized for, NULL if none
+static struct model *
+model_for(const frame_meta_t *meta)
+{
+    if (meta->width == active->input_width &&
+        meta->height == active->input_height)
+        return active;
+    if (previous != NULL && meta->width == previous->input_width &&
+        meta->height == previous->input_height)
+        return previous;
+    return NULL;
+}
+
+// Run the frame, or add it to the batch being gathered.
+static void
+process_frame(const void *msgPayload, size_t msgPayloadLen)
+{
+    // Carried over to the outputs so later stages can match them with
+    // the frame.
+    frame_meta_t meta;
+    if (frame_meta_read(msgPayload, msgPayloadLen, &meta)) {
+        struct model *m = model_for(&meta);
+        if (m == NULL) {
+            LOG_DBG("Skipping frame %u of %ux%u", meta.frame_id, meta.width,
+                    meta.height);
+            return;
+        }
+        if (skip_frame(&meta)) {
+            queue_output(&meta, true);
+            return;
+        }
+        if (m == previous) {
+            run_previous(msgPayload, &meta);
+            return;
+        }
+    } else if (msgPayloadLen < (size_t)active->input_size) {
+        LOG_WARN("Frame of %zu bytes is too small", msgPayloadLen);
+        return;
+    } else {
+        LOG_DBG("Frame without metadata");
+        meta.width = active->input_width;
+        meta.height = active->input_height;
+        if (skip_frame(&meta)) {
+            queue_output(&meta, true);
+            return;
+        }
+    }
+
+    // Frames arrive in the order they were granted: none of the old size
+    // follow this one.
+    if (previous != NULL)
+        retire_previous();
+
+    queue_output(&meta, false);
+    // The payload is only valid during this call.
+    memcpy(active->frames + (size_t)batch_count * active->input_size,
+           msgPayload, active->input_size);
+    if (batch_count++ == 0)
+        batch_started_ms = now_ms();
+    if (batch_count >= active->batch_size)
+        run_batch();
 }
 
 static void
@@ -255,29 +1447,117 @@ message_cb(const char *topic, const void *msgPayload, size_t msgPayloadLen,
     LOG_INFO("%s: Received Message: (%d) (topic=%s, size=%zu)", module_name,
              inps++, topic, msgPayloadLen);
 
-    if (state != RUN_MODEL) {
+    if (active == NULL) {
         LOG_INFO("Model not loaded, skipping!");
         return;
     }
 
-    uint32_t out_size;
-    float *input_tensor = (float *)malloc(input_size * sizeof(float));
-    uint8_t *input_tensor_n = (uint8_t *)msgPayload;
-    for (int i = 0; i < input_size; ++i) {
-        input_tensor[i] = ((float)input_tensor_n[i]) / 255;
-    }
-    char *output_tensor_fb =
-        run_inference((char *)input_tensor, input_size, &out_size);
-    free(input_tensor);
-    gettimeofday(&end, NULL);
-    total = (end.tv_sec - start.tv_sec) +
-            (end.tv_usec - start.tv_usec) / 1000000.0;
-    LOG_DBG("Total time: %f seconds", total);
-    gettimeofday(&start, NULL);
+    process_frame(msgPayload, msgPayloadLen);
+    // The credit goes back once the frame is done with, so the source
+    // keeps the next frame until then, replacing it with newer captures,
+    // instead of queuing it behind this one.
+    send_credits(1);
+}
+
+// "B [deadline_ms]": run up to B frames at once, waiting at most
+// deadline_ms for them after the first.
+static void
+set_batch_request(const char *params)
+{
+    unsigned size, deadline;
+    int n = sscanf(params, "%u %u", &size, &deadline);
+    if (n < 1 || size == 0) {
+        LOG_WARN("Invalid batch %s", params);
+        return;
+    }
+    batch_request = size < MAX_BATCH ? size : MAX_BATCH;
+    if (n == 2)
+        batch_deadline_ms = deadline;
+    batch_request_changed = true;
+}
+
+// "N": run one frame in N of each camera through the model, see
+// README.md.
+static void
+set_stride(const char *params)
+{
+    unsigned n;
+    if (sscanf(params, "%u", &n) != 1 || n == 0) {
+        LOG_WARN("Invalid stride %s", params);
+        return;
+    }
+    stride = n;
+    // The next frame of each camera runs.
+    memset(stride_count, 0, sizeof(stride_count));
+    LOG_INFO("Running one frame in %u", stride);
+}
 
-    send_message(OUTPUT_TOPIC, output_tensor_fb, out_size);
+// JSON object, see README.md. Its settings apply from the next frame, the
+// missing ones taking their defaults; its model is loaded like the first
+// stage. Without a model, the cascade is turned off.
+static void
+set_cascade(const char *params)
+{
+    JSON_Value *value = json_parse_string(params);
+    const JSON_Object *o = json_value_get_object(value);
+    if (o == NULL) {
+        LOG_WARN("Invalid cascade %s", params);
+        json_value_free(value);
+        return;
+    }
 
-    state = GET_DATA;
+    free(cascade_url);
+    cascade_url = NULL;
+    const char *url = json_object_get_string(o, "model");
+    if (url != NULL && active != NULL && !cascade_fits(active)) {
+        LOG_ERR("Cascade rejected: the detector has %u outputs, not the %u "
+                "of the SSD postprocess op",
+                active->num_outputs, SSD_NUM_OUTPUTS);
+        json_value_free(value);
+        return;
+    }
+    if (url == NULL) {
+        if (cascade.model.url != NULL) {
+            LOG_INFO("Cascade off");
+            release_model(&cascade.model);
+            report_model_state("ready");
+        }
+        json_value_free(value);
+        return;
+    }
+
+    cascade.score_threshold = CASCADE_SCORE_THRESHOLD;
+    if (json_object_has_value_of_type(o, "score_threshold", JSONNumber))
+        cascade.score_threshold =
+            json_object_get_number(o, "score_threshold");
+    const JSON_Array *classes = json_object_get_array(o, "classes");
+    cascade.all_classes = classes == NULL;
+    memset(cascade.classes, 0, sizeof(cascade.classes));
+    for (size_t i = 0; i < json_array_get_count(classes); ++i) {
+        double cls = json_array_get_number(classes, i);
+        if (cls >= 0 && cls < CASCADE_MAX_CLASSES)
+            cascade.classes[(uint32_t)cls] = true;
+    }
+    cascade.max_crops = MAX_CROPS;
+    if (json_object_has_value_of_type(o, "max_crops", JSONNumber)) {
+        double n = json_object_get_number(o, "max_crops");
+        cascade.max_crops = n < 1 ? 1 : n > MAX_CROPS ? MAX_CROPS : n;
+    }
+    cascade.margin = 0;
+    if (json_object_has_value_of_type(o, "margin", JSONNumber)) {
+        double margin = json_object_get_number(o, "margin");
+        cascade.margin = margin < 0 ? 0 : margin > 1 ? 1 : margin;
+    }
+    cascade.fit = IMAGE_FIT_STRETCH;
+    const char *fit = json_object_get_string(o, "fit");
+    if (fit != NULL && image_fit_parse(fit, &cascade.fit) != 0)
+        LOG_WARN("Unknown fit %s", fit);
+
+    if (cascade.model.url != NULL)
+        cascade_setup_buffers();
+    if (cascade.model.url == NULL || strcmp(url, cascade.model.url) != 0)
+        cascade_url = strdup(url);
+    json_value_free(value);
 }
 
 void
@@ -286,7 +1566,15 @@ rpc_callback(EVP_RPC_ID id, const char *methodName, const char *params,
 {
     LOG_DBG("RPC: methodName=%s params=%s", methodName, params);
     if (strcmp(methodName, "config") == 0) {
+        // Only the latest request is kept
+        free(model_url);
         model_url = strdup(params);
+    } else if (strcmp(methodName, "batch") == 0) {
+        set_batch_request(params);
+    } else if (strcmp(methodName, "cascade") == 0) {
+        set_cascade(params);
+    } else if (strcmp(methodName, "stride") == 0) {
+        set_stride(params);
     } else {
         LOG_WARN("Invalid RPC.");
     }
@@ -313,27 +1601,50 @@ main(int argc, const char *argv[])
 
     const char *workspace =
         EVP_getWorkspaceDirectory(h, EVP_WORKSPACE_TYPE_DEFAULT);
-    asprintf(&model_file, "%s/%s", workspace, "model.tflite");
-    download_model();
+    model_cache_init(workspace, MODEL_CACHE_ENTRIES);
 
     for (;;) {
-        EVP_RESULT result = EVP_processEvent(h, 1000);
+        if (state == IDLE && model_url != NULL)
+            start_loading(&model_url, false);
+        else if (state == IDLE && cascade_url != NULL)
+            start_loading(&cascade_url, true);
+        else if (state == RETRY_DOWNLOAD && now_ms() >= retry_at_ms)
+            download_model();
+
+        // Wake up for the deadline of a partial batch
+        int timeout = state == LOAD_MODEL ? 0 : 1000;
+        if (batch_count > 0) {
+            uint64_t waited = now_ms() - batch_started_ms;
+            timeout = waited < batch_deadline_ms
+                          ? (int)(batch_deadline_ms - waited)
+                          : 0;
+        }
+        EVP_RESULT result = EVP_processEvent(h, timeout);
         if (result == EVP_SHOULDEXIT) {
             LOG_INFO("%s: exiting the main loop", module_name);
             break;
         }
-        if (state == LOAD_MODEL) {
+        if (batch_count > 0 &&
+            now_ms() - batch_started_ms >= batch_deadline_ms)
+            run_batch();
+        if (batch_request_changed && active != NULL)
+            apply_batch_request();
+        // Loaded between two frames. There are no threads to load it
+        // alongside, so the frames in flight wait in the queue meanwhile.
+        if (state == LOAD_MODEL)
             load_model();
-            state = GET_DATA;
-
-        } else if (state == GET_DATA) {
-            LOG_INFO("Requesting tensors...");
-            send_message(REQUEST_TOPIC, NULL, 0);
-            state = RUN_MODEL;
-        }
     }
 END:
     free(model_url);
+    free(loading_url);
     free(model_file);
+    for (int i = 0; i < 2; ++i)
+        release_model(&models[i]);
+    free(cascade_url);
+    release_model(&cascade.model);
+    free(cascade.detections);
+    free(cascade.results);
+    free(cascade.chunk);
+    model_cache_deinit();
     return 0;
 }
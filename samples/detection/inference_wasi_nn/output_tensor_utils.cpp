@@ -3,18 +3,93 @@
 #include "flatbuffers/flatbuffers.h"
 #include "output_tensor_generated.h"
 
-char *
-creat_output_tensor_fb(float *buf, uint32_t buf_size, uint32_t *out_size)
-{
+#include <vector>
+
+// Enough for the outputs of a full batch (see main.c) while those of the
+// previous one are still being sent. Builders only allocate once used.
+#define OUTPUT_TENSOR_SLOTS 10
+
+struct output_tensor_fb {
     flatbuffers::FlatBufferBuilder builder;
+    std::vector<flatbuffers::Offset<output_tensor::Tensor>> tensors;
+    // Tensor being added
+    output_tensor_type_t type;
+    flatbuffers::uoffset_t data;
+    bool in_use;
+};
+
+static output_tensor_fb slots[OUTPUT_TENSOR_SLOTS];
+
+output_tensor_fb_t *
+output_tensor_fb_acquire(void)
+{
+    for (auto &slot : slots) {
+        if (slot.in_use)
+            continue;
+        // Clear() keeps the buffer allocated, so after the first frames
+        // this no longer allocates.
+        slot.builder.Clear();
+        slot.tensors.clear();
+        slot.in_use = true;
+        return &slot;
+    }
+    return NULL;
+}
+
+void *
+output_tensor_fb_begin_tensor(output_tensor_fb_t *fb,
+                              output_tensor_type_t type, uint32_t count)
+{
+    // The pointer is only valid until the builder grows again, which is why
+    // the data has to be written before the tensor is completed.
+    uint8_t *data;
+    size_t size = type == OUTPUT_TENSOR_FLOAT32 ? sizeof(float) : 1;
+    fb->type = type;
+    fb->data = fb->builder.CreateUninitializedVector(count, size, size, &data);
+    return data;
+}
+
+void
+output_tensor_fb_end_tensor(output_tensor_fb_t *fb, const uint32_t *shape,
+                            uint32_t num_dims, float scale,
+                            int32_t zero_point)
+{
+    auto &b = fb->builder;
+    auto dims = b.CreateVector(shape, num_dims);
+    output_tensor::TensorBuilder tb(b);
+    tb.add_shape(dims);
+    tb.add_type(static_cast<output_tensor::TensorType>(fb->type));
+    tb.add_scale(scale);
+    tb.add_zero_point(zero_point);
+    switch (fb->type) {
+    case OUTPUT_TENSOR_FLOAT32:
+        tb.add_data_f32(fb->data);
+        break;
+    case OUTPUT_TENSOR_UINT8:
+        tb.add_data_u8(fb->data);
+        break;
+    case OUTPUT_TENSOR_INT8:
+        tb.add_data_i8(fb->data);
+        break;
+    }
+    fb->tensors.push_back(tb.Finish());
+}
 
-    auto data = builder.CreateVector(buf, buf_size);
-    auto ot = output_tensor::CreateOutputTensor(builder, data);
-    builder.Finish(ot);
-    *out_size = builder.GetSize();
+const uint8_t *
+output_tensor_fb_finish(output_tensor_fb_t *fb, const frame_meta_t *meta,
+                        uint32_t *out_size)
+{
+    auto tensors = fb->builder.CreateVector(fb->tensors);
+    auto ot = output_tensor::CreateOutputTensor(
+        fb->builder, 0, tensors, meta->frame_id, meta->timestamp,
+        meta->width, meta->height, meta->stream_id);
+    fb->builder.Finish(ot);
+    *out_size = fb->builder.GetSize();
+    return fb->builder.GetBufferPointer();
+}
 
-    char *ret_buffer = (char *)malloc(*out_size);
-    memcpy(ret_buffer, builder.GetBufferPointer(), *out_size);
-    builder.Clear();
-    return ret_buffer;
+void
+output_tensor_fb_release(output_tensor_fb_t *fb)
+{
+    fb->in_use = false;
 }
@@ -1,11 +1,54 @@
 #include <stdint.h>
 
+#include "frame_meta.h"
+
 #ifdef __cplusplus
 extern "C" {
 #endif
 
-char *creat_output_tensor_fb(float *buf, uint32_t buf_size,
-                             uint32_t *out_size);
+// Wire type of a tensor, same values as output_tensor::TensorType
+typedef enum {
+    OUTPUT_TENSOR_FLOAT32 = 0,
+    OUTPUT_TENSOR_UINT8,
+    OUTPUT_TENSOR_INT8,
+} output_tensor_type_t;
+
+// A reusable OutputTensor flatbuffer. The buffer stays valid until it is
+// released, so it can be handed to EVP_sendMessage without a copy.
+typedef struct output_tensor_fb output_tensor_fb_t;
+
+/**
+ * Take a free builder.
+ *
+ * @return NULL if every builder is still in flight.
+ */
+output_tensor_fb_t *output_tensor_fb_acquire(void);
+
+/**
+ * Reserve the data of the next tensor: `count` elements of `type`, to be
+ * written through the returned pointer before any other call on `fb`.
+ */
+void *output_tensor_fb_begin_tensor(output_tensor_fb_t *fb,
+                                    output_tensor_type_t type,
+                                    uint32_t count);
+
+/**
+ * Complete the tensor started by output_tensor_fb_begin_tensor(). `scale`
+ * is 0 for float data.
+ */
+void output_tensor_fb_end_tensor(output_tensor_fb_t *fb, const uint32_t *shape,
+                                 uint32_t num_dims, float scale,
+                                 int32_t zero_point);
+
+/**
+ * Finish the OutputTensor table once all tensors have been added, tagged
+ * with the id, timestamp and size of the frame they were computed from.
+ */
+const uint8_t *output_tensor_fb_finish(output_tensor_fb_t *fb,
+                                       const frame_meta_t *meta,
+                                       uint32_t *out_size);
+
+void output_tensor_fb_release(output_tensor_fb_t *fb);
 
 #ifdef __cplusplus
 }
@@ -0,0 +1,417 @@
+#include "decode.h"
+
+#include <algorithm>
+#include <math.h>
+#include <string.h>
+#include <vector>
+
+#include "json_get.h"
+#include "logger.h"
+#include "tensor_ops.h"
+
+namespace {
+
+struct anchor {
+    float cy;
+    float cx;
+    float h;
+    float w;
+};
+
+struct candidate {
+    float score;
+    uint32_t index;
+    uint32_t cls;
+};
+
+decode_config_t config;
+std::vector<anchor> anchors;
+std::vector<candidate> candidates;
+std::vector<decode_detection_t> boxes_scratch;
+std::vector<float> iou_matrix;
+std::vector<uint32_t> hits;
+std::vector<bool> keep;
+
+bool
+by_score(const candidate &a, const candidate &b)
+{
+    return a.score > b.score;
+}
+
+float
+layer_scale(const decode_anchor_config_t *a, uint32_t layer)
+{
+    if (a->num_layers == 1)
+        return (a->min_scale + a->max_scale) / 2;
+    return a->min_scale +
+           (a->max_scale - a->min_scale) * layer / (a->num_layers - 1);
+}
+
+// Same anchor layout as the TF Object Detection API multiple grid anchor
+// generator that the SSD postprocess op is exported with.
+void
+generate_anchors(const decode_config_t *cfg)
+{
+    const decode_anchor_config_t *a = &cfg->anchors;
+    anchors.clear();
+
+    uint32_t layer = 0;
+    while (layer < a->num_layers) {
+        std::vector<float> scales, ratios;
+        uint32_t last = layer;
+        for (; last < a->num_layers && a->strides[last] == a->strides[layer];
+             ++last) {
+            float scale = layer_scale(a, last);
+            if (last == 0 && a->reduce_boxes_in_lowest_layer) {
+                scales.insert(scales.end(), {0.1f, scale, scale});
+                ratios.insert(ratios.end(), {1.0f, 2.0f, 0.5f});
+                continue;
+            }
+            for (uint32_t r = 0; r < a->num_aspect_ratios; ++r) {
+                scales.push_back(scale);
+                ratios.push_back(a->aspect_ratios[r]);
+            }
+            if (a->interpolated_scale_aspect_ratio > 0) {
+                float next = last == a->num_layers - 1
+                                 ? 1.0f
+                                 : layer_scale(a, last + 1);
+                scales.push_back(sqrtf(scale * next));
+                ratios.push_back(a->interpolated_scale_aspect_ratio);
+            }
+        }
+
+        uint32_t stride = a->strides[layer];
+        uint32_t fm_h = (cfg->input_height + stride - 1) / stride;
+        uint32_t fm_w = (cfg->input_width + stride - 1) / stride;
+        for (uint32_t y = 0; y < fm_h; ++y) {
+            for (uint32_t x = 0; x < fm_w; ++x) {
+                for (size_t i = 0; i < scales.size(); ++i) {
+                    float ratio = sqrtf(ratios[i]);
+                    anchors.push_back({(y + 0.5f) / fm_h, (x + 0.5f) / fm_w,
+                                       scales[i] / ratio, scales[i] * ratio});
+                }
+            }
+        }
+        layer = last;
+    }
+}
+
+// Keep the `k` best candidates. Returns the lowest score kept, which is the
+// bar any further candidate has to clear.
+float
+keep_top_k(uint32_t k)
+{
+    if (candidates.size() > k) {
+        std::nth_element(candidates.begin(), candidates.begin() + k - 1,
+                         candidates.end(), by_score);
+        candidates.resize(k);
+    }
+    float lowest = candidates[0].score;
+    for (const candidate &c : candidates)
+        lowest = std::min(lowest, c.score);
+    return lowest;
+}
+
+// Collect the (box, class) pairs scoring at least `threshold`. Rows are
+// scanned with the vectorized tensor_find_ge(); whenever the candidate
+// buffer fills up it is cut down to top_k and the threshold raised to the
+// k-th score, so later rows are mostly skipped.
+void
+collect_candidates(const float *scores, uint32_t num_rows, uint32_t stride,
+                   uint32_t first_class, uint32_t num_classes,
+                   const float *objectness, float threshold)
+{
+    const uint32_t capacity = std::max(config.top_k * 4, 1024u);
+    candidates.clear();
+    hits.resize(num_classes);
+
+    for (uint32_t row = 0; row < num_rows; ++row) {
+        float obj = 1.0f;
+        float bar = threshold;
+        if (objectness != nullptr) {
+            obj = objectness[row * stride];
+            if (obj < threshold)
+                continue;
+            bar = threshold / obj;
+        }
+
+        const float *row_scores = scores + row * stride + first_class;
+        uint32_t n =
+            tensor_find_ge(row_scores, num_classes, bar, hits.data(),
+                           num_classes);
+        for (uint32_t i = 0; i < n; ++i) {
+            candidates.push_back(
+                {row_scores[hits[i]] * obj, row, hits[i]});
+        }
+
+        if (candidates.size() >= capacity)
+            threshold = std::max(threshold, keep_top_k(config.top_k));
+    }
+    if (!candidates.empty())
+        keep_top_k(config.top_k);
+}
+
+float
+iou(const decode_detection_t &a, const decode_detection_t &b)
+{
+    float w = std::min(a.x_max, b.x_max) - std::max(a.x_min, b.x_min);
+    float h = std::min(a.y_max, b.y_max) - std::max(a.y_min, b.y_min);
+    if (w <= 0 || h <= 0)
+        return 0;
+    float inter = w * h;
+    float area_a = (a.x_max - a.x_min) * (a.y_max - a.y_min);
+    float area_b = (b.x_max - b.x_min) * (b.y_max - b.y_min);
+    return inter / (area_a + area_b - inter);
+}
+
+// Greedy NMS over boxes[begin, end), which share a class and are sorted by
+// decreasing score. The pairwise IoUs are computed up front as an upper
+// triangular matrix, then one pass keeps each box not overlapping a kept
+// one.
+void
+suppress(std::vector<decode_detection_t> &boxes, size_t begin, size_t end,
+         std::vector<bool> &keep)
+{
+    size_t k = end - begin;
+    iou_matrix.resize(k * k);
+    for (size_t i = 0; i < k; ++i) {
+        for (size_t j = i + 1; j < k; ++j)
+            iou_matrix[i * k + j] = iou(boxes[begin + i], boxes[begin + j]);
+    }
+
+    for (size_t i = 0; i < k; ++i) {
+        if (!keep[begin + i])
+            continue;
+        for (size_t j = i + 1; j < k; ++j) {
+            if (iou_matrix[i * k + j] > config.iou_threshold)
+                keep[begin + j] = false;
+        }
+    }
+}
+
+void
+decode_ssd_box(const float *enc, const anchor &a, decode_detection_t *d)
+{
+    float cy = enc[0] / config.box_scale[0] * a.h + a.cy;
+    float cx = enc[1] / config.box_scale[1] * a.w + a.cx;
+    float h = expf(enc[2] / config.box_scale[2]) * a.h;
+    float w = expf(enc[3] / config.box_scale[3]) * a.w;
+    d->y_min = cy - h / 2;
+    d->x_min = cx - w / 2;
+    d->y_max = cy + h / 2;
+    d->x_max = cx + w / 2;
+}
+
+void
+decode_yolo_box(const float *row, decode_detection_t *d)
+{
+    float cx = row[0] / config.input_width;
+    float cy = row[1] / config.input_height;
+    float w = row[2] / config.input_width;
+    float h = row[3] / config.input_height;
+    d->y_min = cy - h / 2;
+    d->x_min = cx - w / 2;
+    d->y_max = cy + h / 2;
+    d->x_max = cx + w / 2;
+}
+
+float
+sigmoid(float x)
+{
+    return 1.0f / (1.0f + expf(-x));
+}
+
+} // namespace
+
+void
+decode_default_config(decode_config_t *cfg)
+{
+    static const decode_config_t defaults = {
+        .enabled = false,
+        .format = DECODE_FORMAT_SSD,
+        .num_classes = 91,
+        .input_width = 300,
+        .input_height = 300,
+        .score_threshold = 0.5f,
+        .iou_threshold = 0.6f,
+        .top_k = 100,
+        .max_detections = 10,
+        .class_agnostic = false,
+        .box_scale = {10, 10, 5, 5},
+        .anchors =
+            {
+                .num_layers = 6,
+                .min_scale = 0.2f,
+                .max_scale = 0.95f,
+                .strides = {16, 32, 64, 128, 256, 512},
+                .aspect_ratios = {1.0f, 2.0f, 0.5f, 3.0f, 0.3333f},
+                .num_aspect_ratios = 5,
+                .reduce_boxes_in_lowest_layer = true,
+                .interpolated_scale_aspect_ratio = 1.0f,
+            },
+    };
+    *cfg = defaults;
+}
+
+int
+decode_parse_config(const JSON_Object *params, decode_config_t *cfg)
+{
+    const JSON_Object *o = json_object_get_object(params, "decode");
+    if (o == nullptr)
+        return 0;
+    cfg->enabled = json_get_bool(o, "enabled", true);
+
+    const char *format = json_object_get_string(o, "format");
+    if (format != nullptr && strcmp(format, "yolo") == 0)
+        cfg->format = DECODE_FORMAT_YOLO;
+    if (!json_get_uint(o, "num_classes", cfg->num_classes,
+                       &cfg->num_classes) ||
+        !json_get_uint(o, "input_width", cfg->input_width,
+                       &cfg->input_width) ||
+        !json_get_uint(o, "input_height", cfg->input_height,
+                       &cfg->input_height) ||
+        !json_get_uint(o, "top_k", cfg->top_k, &cfg->top_k) ||
+        !json_get_uint(o, "max_detections", cfg->max_detections,
+                       &cfg->max_detections)) {
+        LOG_ERR("Invalid decode configuration");
+        return -1;
+    }
+    cfg->score_threshold =
+        json_get_number(o, "score_threshold", cfg->score_threshold);
+    cfg->iou_threshold =
+        json_get_number(o, "iou_threshold", cfg->iou_threshold);
+    cfg->class_agnostic =
+        json_get_bool(o, "class_agnostic", cfg->class_agnostic);
+    json_get_array(o, "box_scale", cfg->box_scale, 4);
+
+    const JSON_Object *a = json_object_get_object(o, "anchors");
+    if (a != nullptr) {
+        decode_anchor_config_t *ac = &cfg->anchors;
+        ac->min_scale = json_get_number(a, "min_scale", ac->min_scale);
+        ac->max_scale = json_get_number(a, "max_scale", ac->max_scale);
+        uint32_t n =
+            json_get_array(a, "strides", ac->strides, DECODE_MAX_LAYERS);
+        if (n > 0)
+            ac->num_layers = n;
+        n = json_get_array(a, "aspect_ratios", ac->aspect_ratios,
+                           DECODE_MAX_ASPECT_RATIOS);
+        if (n > 0)
+            ac->num_aspect_ratios = n;
+        ac->reduce_boxes_in_lowest_layer =
+            json_get_bool(a, "reduce_boxes_in_lowest_layer",
+                          ac->reduce_boxes_in_lowest_layer);
+        ac->interpolated_scale_aspect_ratio =
+            json_get_number(a, "interpolated_scale_aspect_ratio",
+                            ac->interpolated_scale_aspect_ratio);
+    }
+    return 0;
+}
+
+int
+decode_init(const decode_config_t *cfg)
+{
+    if (cfg->enabled &&
+        (cfg->num_classes == 0 || cfg->num_classes > DECODE_MAX_CLASSES ||
+         cfg->top_k == 0 || cfg->top_k > DECODE_MAX_TOP_K ||
+         cfg->input_width == 0 || cfg->input_height == 0 ||
+         cfg->score_threshold <= 0 ||
+         cfg->score_threshold >= 1)) {
+        LOG_ERR("Invalid decode configuration");
+        return -1;
+    }
+    config = *cfg;
+    anchors.clear();
+    if (config.enabled && config.format == DECODE_FORMAT_SSD) {
+        generate_anchors(&config);
+        LOG_INFO("Decoding SSD outputs against %zu anchors", anchors.size());
+    }
+    return 0;
+}
+
+int
+decode_run(const float *boxes, uint32_t boxes_size, const float *scores,
+           uint32_t scores_size, decode_detection_t *out, uint32_t max)
+{
+    uint32_t num_rows;
+    if (config.format == DECODE_FORMAT_SSD) {
+        num_rows = anchors.size();
+        if (boxes_size != num_rows * 4 ||
+            scores_size != num_rows * config.num_classes) {
+            LOG_ERR("Expected %u anchors with %u classes", num_rows,
+                    config.num_classes);
+            return -1;
+        }
+        // Sigmoid is monotonic, so threshold the logits and skip class 0,
+        // the background.
+        float t = config.score_threshold;
+        collect_candidates(scores, num_rows, config.num_classes, 1,
+                           config.num_classes - 1, nullptr,
+                           logf(t / (1 - t)));
+    } else {
+        uint32_t stride = 5 + config.num_classes;
+        if (boxes_size % stride != 0) {
+            LOG_ERR("Rows of %u values expected", stride);
+            return -1;
+        }
+        num_rows = boxes_size / stride;
+        collect_candidates(boxes, num_rows, stride, 5, config.num_classes,
+                           boxes + 4, config.score_threshold);
+    }
+
+    // Decode only the boxes that made it, sorted by class then score.
+    std::sort(candidates.begin(), candidates.end(),
+              [](const candidate &a, const candidate &b) {
+                  uint32_t ca = config.class_agnostic ? 0 : a.cls;
+                  uint32_t cb = config.class_agnostic ? 0 : b.cls;
+                  return ca != cb ? ca < cb : a.score > b.score;
+              });
+    boxes_scratch.resize(candidates.size());
+    for (size_t i = 0; i < candidates.size(); ++i) {
+        const candidate &c = candidates[i];
+        decode_detection_t *d = &boxes_scratch[i];
+        if (config.format == DECODE_FORMAT_SSD) {
+            decode_ssd_box(boxes + c.index * 4, anchors[c.index], d);
+            d->score = sigmoid(c.score);
+        } else {
+            decode_yolo_box(boxes + c.index * (5 + config.num_classes), d);
+            d->score = c.score;
+        }
+        d->cls = c.cls;
+    }
+
+    keep.assign(boxes_scratch.size(), true);
+    for (size_t begin = 0; begin < boxes_scratch.size();) {
+        size_t end = begin + 1;
+        while (end < boxes_scratch.size() &&
+               (config.class_agnostic ||
+                boxes_scratch[end].cls == boxes_scratch[begin].cls))
+            ++end;
+        suppress(boxes_scratch, begin, end, keep);
+        begin = end;
+    }
+
+    uint32_t n = 0;
+    max = std::min(max, config.max_detections);
+    for (size_t i = 0; i < boxes_scratch.size(); ++i) {
+        if (keep[i])
+            boxes_scratch[n++] = boxes_scratch[i];
+    }
+    std::sort(boxes_scratch.begin(), boxes_scratch.begin() + n,
+              [](const decode_detection_t &a, const decode_detection_t &b) {
+                  return a.score > b.score;
+              });
+    n = std::min(n, max);
+    std::copy(boxes_scratch.begin(), boxes_scratch.begin() + n, out);
+    return n;
+}
+
+void
+decode_deinit(void)
+{
+    anchors = std::vector<anchor>();
+    candidates = std::vector<candidate>();
+    boxes_scratch = std::vector<decode_detection_t>();
+    iou_matrix = std::vector<float>();
+    hits = std::vector<uint32_t>();
+    keep = std::vector<bool>();
+}
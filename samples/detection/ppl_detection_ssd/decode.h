@@ -0,0 +1,98 @@
+#ifndef DECODE_H
+#define DECODE_H
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "parson.h"
+
+#define DECODE_MAX_LAYERS        8
+#define DECODE_MAX_ASPECT_RATIOS 8
+// Largest num_classes and top_k accepted, so that row and candidate
+// buffer sizes stay well within 32 bits
+#define DECODE_MAX_CLASSES 4096
+#define DECODE_MAX_TOP_K   16384
+
+// Layout of the raw model outputs
+typedef enum {
+    // Tensor 0: [N, 4] box encodings (ty, tx, th, tw) against anchors.
+    // Tensor 1: [N, C] class logits, class 0 being background.
+    DECODE_FORMAT_SSD = 0,
+    // Tensor 0: [N, 5 + C] rows of (cx, cy, w, h, objectness, classes...),
+    // already decoded, in input pixels.
+    DECODE_FORMAT_YOLO,
+} decode_format_t;
+
+// SSD anchor generator parameters, as in the TF Object Detection API
+typedef struct {
+    uint32_t num_layers;
+    float min_scale;
+    float max_scale;
+    uint32_t strides[DECODE_MAX_LAYERS];
+    float aspect_ratios[DECODE_MAX_ASPECT_RATIOS];
+    uint32_t num_aspect_ratios;
+    bool reduce_boxes_in_lowest_layer;
+    float interpolated_scale_aspect_ratio;
+} decode_anchor_config_t;
+
+typedef struct {
+    bool enabled;
+    decode_format_t format;
+    uint32_t num_classes;
+    uint32_t input_width;
+    uint32_t input_height;
+    float score_threshold;
+    float iou_threshold;
+    // Candidates kept for NMS, and detections kept after it
+    uint32_t top_k;
+    uint32_t max_detections;
+    // Suppress overlapping boxes across classes as well
+    bool class_agnostic;
+    // SSD box coder scales for y, x, h, w
+    float box_scale[4];
+    decode_anchor_config_t anchors;
+} decode_config_t;
+
+typedef struct {
+    float y_min;
+    float x_min;
+    float y_max;
+    float x_max;
+    float score;
+    uint32_t cls;
+} decode_detection_t;
+
+/**
+ * Defaults for a 300x300 SSD MobileNet export, decoding disabled.
+ */
+void decode_default_config(decode_config_t *cfg);
+
+/**
+ * Override `cfg` with the "decode" object of the PPL parameters, if any.
+ * Missing keys keep their current value.
+ *
+ * @return 0 on success, -1 if a count is not a whole number that fits a
+ * uint32_t, in which case `cfg` must not be used.
+ */
+int decode_parse_config(const JSON_Object *params, decode_config_t *cfg);
+
+/**
+ * Apply `cfg`, generating the SSD anchors if needed.
+ *
+ * @return 0 on success, -1 if the configuration is invalid.
+ */
+int decode_init(const decode_config_t *cfg);
+
+/**
+ * Decode raw outputs into at most `max` detections sorted by score, with
+ * coordinates normalized to [0, 1].
+ *
+ * @return the number of detections, or -1 if the tensors do not match the
+ * configuration.
+ */
+int decode_run(const float *boxes, uint32_t boxes_size, const float *scores,
+               uint32_t scores_size, decode_detection_t *out, uint32_t max);
+
+void decode_deinit(void);
+
+#endif
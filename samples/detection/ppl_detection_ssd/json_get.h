@@ -0,0 +1,60 @@
+#ifndef JSON_GET_H
+#define JSON_GET_H
+
+#include <algorithm>
+#include <math.h>
+#include <stdint.h>
+
+#include "parson.h"
+
+// Typed lookups on the PPL parameters that fall back to `def` when the key
+// is missing or has the wrong type.
+
+inline float
+json_get_number(const JSON_Object *o, const char *key, float def)
+{
+    return json_object_has_value_of_type(o, key, JSONNumber)
+               ? (float)json_object_get_number(o, key)
+               : def;
+}
+
+// Unlike the other lookups, a number that is not a whole uint32_t is an
+// error: false is returned and `*out` is left alone.
+inline bool
+json_get_uint(const JSON_Object *o, const char *key, uint32_t def,
+              uint32_t *out)
+{
+    if (!json_object_has_value_of_type(o, key, JSONNumber)) {
+        *out = def;
+        return true;
+    }
+    double v = json_object_get_number(o, key);
+    if (!(v >= 0 && v <= UINT32_MAX) || v != floor(v))
+        return false;
+    *out = (uint32_t)v;
+    return true;
+}
+
+inline bool
+json_get_bool(const JSON_Object *o, const char *key, bool def)
+{
+    return json_object_has_value_of_type(o, key, JSONBoolean)
+               ? json_object_get_boolean(o, key) == 1
+               : def;
+}
+
+// Copy up to `max` numbers of the array `key` into `dst`.
+template <typename T>
+uint32_t
+json_get_array(const JSON_Object *o, const char *key, T *dst, uint32_t max)
+{
+    JSON_Array *a = json_object_get_array(o, key);
+    if (a == nullptr)
+        return 0;
+    uint32_t n = std::min((uint32_t)json_array_get_count(a), max);
+    for (uint32_t i = 0; i < n; ++i)
+        dst[i] = (T)json_array_get_number(a, i);
+    return n;
+}
+
+#endif
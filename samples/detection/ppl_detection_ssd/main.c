@@ -28,7 +28,8 @@ send_message_cb(EVP_MESSAGE_SENT_CALLBACK_REASON reason, void *userData)
     assert(d->topic != NULL);
     assert(d->payload != NULL);
     free(d->topic);
-    free(d->payload);
+    // The payload belongs to the PPL until released.
+    PPL_ResultRelease(d->payload);
     free(d);
 }
 
@@ -46,10 +47,11 @@ send_message(char *topic, char *payload, size_t size)
     EVP_RESULT result =
         EVP_sendMessage(h, d->topic, d->payload, size, send_message_cb, d);
     if (EVP_OK != result) {
-        LOG_DBG("%s %s %d: calling EVP_sendMessage", module_name, d->topic,
+        LOG_ERR("%s %s %d: calling EVP_sendMessage", module_name, d->topic,
                 result);
+        // No callback will come for a message that was not queued.
+        send_message_cb(EVP_MESSAGE_SENT_CALLBACK_REASON_ERROR, d);
     }
-    assert(result == EVP_OK);
 }
 
 static void
@@ -66,11 +68,50 @@ message_cb(const char *topic, const void *msgPayload, size_t msgPayloadLen,
         PPL_Analyze((float *)msgPayload, msgPayloadLen, &pp_out_buf,
                     &p_out_size, &p_upload_flag);
 
+    if (res != E_PPL_OK) {
+        LOG_ERR("%s: PPL_Analyze failed: %d", module_name, res);
+        return;
+    }
     LOG_DBG("Finished analyzing: %d", p_out_size);
+    if (!p_upload_flag)
+        return;
 
     send_message(OUTPUT_TOPIC, (char *)pp_out_buf, p_out_size);
 }
 
+static void
+apply_params(const char *params)
+{
+    if (PPL_Initialize(0, params) != E_PPL_OK)
+        LOG_ERR("Rejected PPL parameters, keeping the previous ones");
+}
+
+// The module configuration holds the PPL parameters as JSON, so they
+// survive restarts and redeployments of the same module.
+static void
+config_cb(const char *topic, const void *config, size_t configlen,
+          void *userData)
+{
+    LOG_DBG("%s: Received configuration (topic=%s, size=%zu)", module_name,
+            topic, configlen);
+    char *params = strndup(config, configlen);
+    assert(params != NULL);
+    apply_params(params);
+    free(params);
+}
+
+void
+rpc_callback(EVP_RPC_ID id, const char *methodName, const char *params,
+             void *userData)
+{
+    LOG_DBG("RPC: methodName=%s params=%s", methodName, params);
+    if (strcmp(methodName, "config") == 0) {
+        apply_params(params);
+    } else {
+        LOG_WARN("Invalid RPC.");
+    }
+}
+
 int
 main(int argc, const char *argv[])
 {
@@ -78,6 +119,13 @@ main(int argc, const char *argv[])
     h = EVP_initialize();
     EVP_RESULT result = EVP_setMessageCallback(h, message_cb, NULL);
     assert(result == EVP_OK);
+    result = EVP_setRpcCallback(h, rpc_callback, NULL);
+    assert(result == EVP_OK);
+    result = EVP_setConfigurationCallback(h, config_cb, NULL);
+    assert(result == EVP_OK);
+
+    EPPL_RESULT_CODE res = PPL_Initialize(0, NULL);
+    assert(res == E_PPL_OK);
 
     for (;;) {
         result = EVP_processEvent(h, 1000);
@@ -86,5 +134,6 @@ main(int argc, const char *argv[])
             break;
         }
     }
+    PPL_Finalize();
     return 0;
 }
@@ -0,0 +1,89 @@
+#include "params.h"
+
+#include <algorithm>
+#include <math.h>
+#include <stdlib.h>
+
+#include "json_get.h"
+#include "logger.h"
+
+namespace {
+
+bool
+valid_threshold(float t)
+{
+    return t >= 0 && t <= 1;
+}
+
+// Class id from a JSON key or number, -1 if it does not fit the table.
+int
+class_id(double v)
+{
+    if (v < 0 || v >= PARAMS_MAX_CLASSES || v != (int)v)
+        return -1;
+    return (int)v;
+}
+
+} // namespace
+
+int
+params_parse(const JSON_Object *o, ppl_params_t *params)
+{
+    params->score_threshold = json_get_number(o, "score_threshold", 0.8f);
+    if (!json_get_uint(o, "max_detections", 10, &params->max_detections) ||
+        !json_get_uint(o, "heartbeat_ms", 5000, &params->heartbeat_ms) ||
+        !json_get_uint(o, "max_num_bboxes", 200, &params->max_num_bboxes) ||
+        !json_get_uint(o, "input_width", 300, &params->input_width) ||
+        !json_get_uint(o, "input_height", 300, &params->input_height) ||
+        !valid_threshold(params->score_threshold) ||
+        params->max_detections == 0 || params->max_num_bboxes == 0 ||
+        params->input_width == 0 || params->input_height == 0) {
+        LOG_ERR("Invalid PPL parameters");
+        return -1;
+    }
+
+    std::fill_n(params->class_thresholds, PARAMS_MAX_CLASSES,
+                params->score_threshold);
+    params->other_threshold = params->score_threshold;
+
+    const JSON_Object *thresholds =
+        json_object_get_object(o, "class_thresholds");
+    for (size_t i = 0; i < json_object_get_count(thresholds); ++i) {
+        char *end;
+        const char *name = json_object_get_name(thresholds, i);
+        int c = class_id(strtod(name, &end));
+        JSON_Value *v = json_object_get_value_at(thresholds, i);
+        float t = json_value_get_number(v);
+        if (*end != '\0' || c < 0 || json_value_get_type(v) != JSONNumber ||
+            !valid_threshold(t)) {
+            LOG_ERR("Invalid threshold for class %s", name);
+            return -1;
+        }
+        params->class_thresholds[c] = t;
+    }
+
+    const JSON_Array *classes = json_object_get_array(o, "classes");
+    if (classes != nullptr) {
+        float allowed[PARAMS_MAX_CLASSES];
+        std::fill_n(allowed, PARAMS_MAX_CLASSES, INFINITY);
+        for (size_t i = 0; i < json_array_get_count(classes); ++i) {
+            int c = class_id(json_array_get_number(classes, i));
+            if (c < 0) {
+                LOG_ERR("Invalid class in the allow-list");
+                return -1;
+            }
+            allowed[c] = params->class_thresholds[c];
+        }
+        std::copy_n(allowed, PARAMS_MAX_CLASSES, params->class_thresholds);
+        params->other_threshold = INFINITY;
+    }
+
+    params->min_threshold = std::min(
+        params->other_threshold,
+        *std::min_element(params->class_thresholds,
+                          params->class_thresholds + PARAMS_MAX_CLASSES));
+    LOG_INFO("PPL parameters: threshold %.2f (lowest %.2f), %u detections",
+             params->score_threshold, params->min_threshold,
+             params->max_detections);
+    return 0;
+}
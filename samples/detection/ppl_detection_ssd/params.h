@@ -0,0 +1,52 @@
+#ifndef PARAMS_H
+#define PARAMS_H
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "parson.h"
+
+// Class ids that can have their own threshold or be allow-listed
+#define PARAMS_MAX_CLASSES 256
+
+typedef struct {
+    // Threshold for classes without their own
+    float score_threshold;
+    // Lowest threshold any class can pass with
+    float min_threshold;
+    uint32_t max_detections;
+    // Longest gap between two uploads of empty frames, 0 for none
+    uint32_t heartbeat_ms;
+    // Boxes per output in the legacy single-vector layout
+    uint32_t max_num_bboxes;
+    uint32_t input_width;
+    uint32_t input_height;
+    // Threshold per class id; classes left out of the allow-list get
+    // +inf, so one lookup both filters and thresholds a detection.
+    float class_thresholds[PARAMS_MAX_CLASSES];
+    // Threshold for class ids past the table
+    float other_threshold;
+} ppl_params_t;
+
+/**
+ * Fill `params` from the PPL parameters: "score_threshold",
+ * "max_detections", "heartbeat_ms", "max_num_bboxes", "input_width",
+ * "input_height", "class_thresholds" (an object of class id to threshold)
+ * and "classes" (the allow-list of class ids). Missing keys take their
+ * defaults.
+ *
+ * @return 0 on success, -1 if a value is out of range.
+ */
+int params_parse(const JSON_Object *o, ppl_params_t *params);
+
+// Whether a detection of class `cls` with `score` is reported.
+static inline bool
+params_accept(const ppl_params_t *params, float score, float cls)
+{
+    uint32_t c = cls > 0 ? (uint32_t)cls : 0;
+    float threshold = c < PARAMS_MAX_CLASSES ? params->class_thresholds[c]
+                                             : params->other_threshold;
+    return score >= threshold;
+}
+
+#endif
@@ -1,7 +1,13 @@
+#include "decode.h"
+#include "frame_meta.h"
 #include "logger.h"
 #include "output_tensor_generated.h"
+#include "params.h"
 #include "postprocessed_detection_generated.h"
 #include "ppl_public.h"
+#include "tensor_ops.h"
+#include <algorithm>
+#include <time.h>
 #include <vector>
 
 #define MAX(a, b) ((a) > (b) ? (a) : (b))
@@ -12,22 +18,393 @@
 /* -------------------------------------------------------- */
 
 // Format: "AA.XX.YY.ZZ" where AA:ID, XX.YY.ZZ : Version
-#define PPL_ID_VERSION              "00.01.00.00"
-#define PPL_SSD_INPUT_TENSOR_WIDTH  300
-#define PPL_SSD_INPUT_TENSOR_HEIGHT 300
-// depends on the postprocessing layer of the network
-#define PPL_SSD_MAX_NUM_BBOXES   200
-#define PPL_MAX_DETECTIONS       10 // maximum bboxes to consider
-#define PPL_CONFIDENCE_THRESHOLD 0.8
+#define PPL_ID_VERSION "00.01.00.00"
+// Order of the SSD postprocess outputs
+#define PPL_SSD_OUTPUT_SCORES  0
+#define PPL_SSD_OUTPUT_BOXES   1
+#define PPL_SSD_OUTPUT_COUNT   2
+#define PPL_SSD_OUTPUT_CLASSES 3
+#define PPL_SSD_NUM_OUTPUTS    4
+// Upper bound on the max_detections parameters
+#define PPL_MAX_DETECTIONS 100
+// Results that can be out at once, waiting for PPL_ResultRelease
+#define PPL_RESULT_SLOTS 4
+// Arena per result: the largest Detection buffer, with the second stage
+// results of a cascade, plus table overhead
+#define PPL_RESULT_SLOT_SIZE                                                  \
+    ((PPL_MAX_DETECTIONS * (sizeof(postprocessed::DetectionAnn) +            \
+                            sizeof(uint32_t) + sizeof(float)) +               \
+      256 + 7) &                                                              \
+     ~(size_t)7)
+
+/* -------------------------------------------------------- */
+/* private function                                         */
+/* -------------------------------------------------------- */
+
+static ppl_params_t params;
+static decode_config_t decode_config;
+
+// Hands the builder its slot's arena. A larger request, which the slot
+// size rules out for the current schema, falls back to the heap.
+class arena_allocator : public flatbuffers::Allocator {
+  public:
+    arena_allocator(uint8_t *base, size_t size) : base_(base), size_(size)
+    {
+    }
+
+    uint8_t *allocate(size_t size) override
+    {
+        if (size <= size_ && !used_) {
+            used_ = true;
+            return base_;
+        }
+        LOG_WARN("PPL result of %zu bytes does not fit its arena", size);
+        return new uint8_t[size];
+    }
+
+    void deallocate(uint8_t *p, size_t size) override
+    {
+        if (p == base_)
+            used_ = false;
+        else
+            delete[] p;
+    }
+
+  private:
+    uint8_t *base_;
+    size_t size_;
+    bool used_ = false;
+};
+
+// The builder is cleared, not destroyed, between frames, so it keeps its
+// buffer and a frame allocates nothing.
+struct result_slot {
+    alignas(8) uint8_t arena[PPL_RESULT_SLOT_SIZE];
+    arena_allocator allocator;
+    flatbuffers::FlatBufferBuilder builder;
+    bool in_use;
+
+    result_slot()
+        : allocator(arena, sizeof(arena)),
+          builder(sizeof(arena), &allocator), in_use(false)
+    {
+    }
+};
+
+static result_slot result_slots[PPL_RESULT_SLOTS];
+static std::vector<postprocessed::DetectionAnn> annotations_scratch;
+// Second stage result of each annotation, empty without a cascade
+static std::vector<uint32_t> cascade_classes;
+static std::vector<float> cascade_scores;
+
+// Upload state of the previous frames of one camera
+struct upload_state {
+    bool last_empty;
+    uint64_t last_ms;
+};
+
+static upload_state upload_states[MAX_STREAMS];
+
+static uint64_t
+now_ms(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000 + ts.tv_nsec / 1000000;
+}
+
+// Frames with detections are always uploaded. Of the empty ones, only the
+// first after detections, so the consumers can clear them, and then one
+// per heartbeat to show the pipeline is alive.
+static bool
+should_upload(const upload_state *state, size_t num_detections, uint64_t now)
+{
+    bool heartbeat = params.heartbeat_ms > 0 &&
+                     now - state->last_ms >= params.heartbeat_ms;
+    return num_detections > 0 || !state->last_empty || heartbeat;
+}
+
+static result_slot *
+acquire_result_slot(void)
+{
+    for (auto &slot : result_slots) {
+        if (!slot.in_use) {
+            slot.in_use = true;
+            slot.builder.Clear();
+            return &slot;
+        }
+    }
+    return nullptr;
+}
+
+struct ssd_outputs {
+    const float *data[PPL_SSD_NUM_OUTPUTS];
+    uint32_t size[PPL_SSD_NUM_OUTPUTS];
+};
+
+// Float view of a tensor; quantized data is expanded into `scratch`.
+static const float *
+tensor_floats(const output_tensor::Tensor *t, std::vector<float> &scratch,
+              uint32_t *size)
+{
+    const uint8_t *q;
+    switch (t->type()) {
+    case output_tensor::TensorType_Float32:
+        if (t->data_f32() == nullptr)
+            return nullptr;
+        *size = t->data_f32()->size();
+        return t->data_f32()->data();
+    case output_tensor::TensorType_UInt8:
+        if (t->data_u8() == nullptr)
+            return nullptr;
+        q = t->data_u8()->data();
+        *size = t->data_u8()->size();
+        break;
+    case output_tensor::TensorType_Int8:
+        if (t->data_i8() == nullptr)
+            return nullptr;
+        q = reinterpret_cast<const uint8_t *>(t->data_i8()->data());
+        *size = t->data_i8()->size();
+        break;
+    default:
+        return nullptr;
+    }
+
+    scratch.resize(*size);
+    tensor_dequantize_8(q, scratch.data(), *size, t->scale(), t->zero_point(),
+                        t->type() == output_tensor::TensorType_Int8);
+    return scratch.data();
+}
+
+// Float views of the first `count` outputs.
+static bool
+get_ssd_outputs(const output_tensor::OutputTensor *ot, ssd_outputs *out,
+                uint32_t count)
+{
+    static std::vector<float> scratch[PPL_SSD_NUM_OUTPUTS];
+
+    auto tensors = ot->tensors();
+    if (tensors != nullptr) {
+        if (tensors->size() < count)
+            return false;
+        for (uint32_t i = 0; i < count; ++i) {
+            out->data[i] =
+                tensor_floats(tensors->Get(i), scratch[i], &out->size[i]);
+            if (out->data[i] == nullptr)
+                return false;
+        }
+        return true;
+    }
+
+    // Legacy producers concatenate the postprocess op outputs into one
+    // vector.
+    auto data = ot->data();
+    const uint32_t n = params.max_num_bboxes;
+    if (count != PPL_SSD_NUM_OUTPUTS || data == nullptr ||
+        data->size() < n * 6 + 1)
+        return false;
+    out->data[PPL_SSD_OUTPUT_SCORES] = data->data();
+    out->size[PPL_SSD_OUTPUT_SCORES] = n;
+    out->data[PPL_SSD_OUTPUT_BOXES] = data->data() + n;
+    out->size[PPL_SSD_OUTPUT_BOXES] = n * 4;
+    out->data[PPL_SSD_OUTPUT_COUNT] = data->data() + n * 5;
+    out->size[PPL_SSD_OUTPUT_COUNT] = 1;
+    out->data[PPL_SSD_OUTPUT_CLASSES] = data->data() + n * 5 + 1;
+    out->size[PPL_SSD_OUTPUT_CLASSES] = n;
+    return true;
+}
+
+static void
+add_detection(std::vector<postprocessed::DetectionAnn> &v, float score,
+              float y_min, float x_min, float y_max, float x_max, float cls)
+{
+    y_min = MIN(1, MAX(0, y_min));
+    x_min = MIN(1, MAX(0, x_min));
+    y_max = MIN(1, MAX(0, y_max));
+    x_max = MIN(1, MAX(0, x_max));
+
+    if (y_min > y_max || x_min > x_max)
+        LOG_WARN("y_min > y_max or x_min > x_max");
+
+    auto bbox = postprocessed::Bbox(x_min, x_max, y_min, y_max);
+    v.push_back(postprocessed::DetectionAnn(bbox, score, cls));
+}
+
+// Raw model outputs: decode, threshold, top-K and NMS here.
+static EPPL_RESULT_CODE
+analyze_raw(const output_tensor::OutputTensor *ot,
+            std::vector<postprocessed::DetectionAnn> &v)
+{
+    uint32_t count = decode_config.format == DECODE_FORMAT_SSD ? 2 : 1;
+    ssd_outputs outputs;
+    if (!get_ssd_outputs(ot, &outputs, count)) {
+        LOG_ERR("Output tensor does not hold the raw outputs");
+        return E_PPL_INVALID_PARAM;
+    }
+
+    // Follow the model input size reported with the outputs; the anchors
+    // and YOLO boxes depend on it.
+    uint32_t width = ot->input_width(), height = ot->input_height();
+    if (width != 0 && height != 0 &&
+        (width != decode_config.input_width ||
+         height != decode_config.input_height)) {
+        LOG_INFO("Model input is %ux%u", width, height);
+        decode_config.input_width = width;
+        decode_config.input_height = height;
+        if (decode_init(&decode_config) != 0)
+            return E_PPL_INVALID_PARAM;
+    }
+
+    decode_detection_t dets[PPL_MAX_DETECTIONS];
+    int n = decode_run(outputs.data[0], outputs.size[0],
+                       count > 1 ? outputs.data[1] : nullptr,
+                       count > 1 ? outputs.size[1] : 0, dets,
+                       PPL_MAX_DETECTIONS);
+    if (n < 0)
+        return E_PPL_INVALID_PARAM;
+    LOG_DBG("Detections: %d", n);
+
+    for (int i = 0; i < n && v.size() < params.max_detections; ++i) {
+        if (params_accept(&params, dets[i].score, dets[i].cls))
+            add_detection(v, dets[i].score, dets[i].y_min, dets[i].x_min,
+                          dets[i].y_max, dets[i].x_max, dets[i].cls);
+    }
+    return E_PPL_OK;
+}
+
+// Top class of the second stage for an SSD row; score 0 if not cropped
+struct cascade_label {
+    uint32_t cls;
+    float score;
+};
+
+// Results the inference appends after the SSD outputs when it runs a
+// cascade: a [K] tensor with the SSD row each crop was cut for, then the
+// second stage outputs with the crops first. The first of those holds the
+// class scores of each crop.
+static bool
+get_cascade_labels(const output_tensor::OutputTensor *ot, uint32_t rows,
+                   std::vector<cascade_label> &labels)
+{
+    static std::vector<float> scratch[2];
+
+    auto tensors = ot->tensors();
+    if (tensors == nullptr || tensors->size() < PPL_SSD_NUM_OUTPUTS + 2)
+        return false;
+    uint32_t crops, size;
+    const float *index = tensor_floats(tensors->Get(PPL_SSD_NUM_OUTPUTS),
+                                       scratch[0], &crops);
+    const float *scores = tensor_floats(
+        tensors->Get(PPL_SSD_NUM_OUTPUTS + 1), scratch[1], &size);
+    if (index == nullptr || scores == nullptr)
+        return false;
+
+    labels.assign(rows, cascade_label{0, 0});
+    uint32_t n = crops > 0 ? size / crops : 0;
+    for (uint32_t c = 0; c < crops && n > 0; ++c) {
+        if (!(index[c] >= 0 && index[c] < rows))
+            continue;
+        const float *p = scores + (size_t)c * n;
+        uint32_t best = 0;
+        for (uint32_t j = 1; j < n; ++j) {
+            if (p[j] > p[best])
+                best = j;
+        }
+        labels[(uint32_t)index[c]] = {best, p[best]};
+    }
+    return true;
+}
+
+// Outputs of the TFLite SSD postprocess op.
+static EPPL_RESULT_CODE
+analyze_postprocessed(const output_tensor::OutputTensor *ot,
+                      std::vector<postprocessed::DetectionAnn> &v)
+{
+    ssd_outputs outputs;
+    if (!get_ssd_outputs(ot, &outputs, PPL_SSD_NUM_OUTPUTS)) {
+        LOG_ERR("Output tensor does not hold the SSD outputs");
+        return E_PPL_INVALID_PARAM;
+    }
+    const float *scores = outputs.data[PPL_SSD_OUTPUT_SCORES];
+    const float *boxes = outputs.data[PPL_SSD_OUTPUT_BOXES];
+    const float *classes = outputs.data[PPL_SSD_OUTPUT_CLASSES];
+    LOG_DBG("Number of bounding boxes: %u",
+            outputs.size[PPL_SSD_OUTPUT_SCORES]);
+    int num_detections = outputs.data[PPL_SSD_OUTPUT_COUNT][0];
+    LOG_DBG("Detections: %d", num_detections);
+
+    int available = std::min({outputs.size[PPL_SSD_OUTPUT_SCORES],
+                              outputs.size[PPL_SSD_OUTPUT_BOXES] / 4,
+                              outputs.size[PPL_SSD_OUTPUT_CLASSES]});
+    num_detections = std::max(std::min(num_detections, available), 0);
+    // Scores are sorted, so only the leading run above the lowest
+    // threshold can hold detections.
+    num_detections = tensor_count_leading_ge(scores, num_detections,
+                                             params.min_threshold);
+
+    static std::vector<cascade_label> labels;
+    bool cascade = get_cascade_labels(ot, available, labels);
+    for (int i = 0; i < num_detections && v.size() < params.max_detections;
+         ++i) {
+        if (!params_accept(&params, scores[i], classes[i]))
+            continue;
+        add_detection(v, scores[i], boxes[i * 4], boxes[i * 4 + 1],
+                      boxes[i * 4 + 2], boxes[i * 4 + 3], classes[i]);
+        if (cascade) {
+            cascade_classes.push_back(labels[i].cls);
+            cascade_scores.push_back(labels[i].score);
+        }
+    }
+    return E_PPL_OK;
+}
 
 /* -------------------------------------------------------- */
 /* public function                                          */
 /* -------------------------------------------------------- */
 
+// p_param: JSON object with the keys of params.h, all optional. A "decode"
+// member enables decoding raw model outputs in the PPL; see decode.h.
+// Either everything is applied or, on error, nothing.
 __attribute__((export_name("PPL_Initialize"))) EPPL_RESULT_CODE
 PPL_Initialize(uint32_t network_id, const char *p_param)
 {
     LOG_INFO("init: im tracking.");
+    JSON_Value *value = p_param ? json_parse_string(p_param) : NULL;
+    if (p_param != NULL && value == NULL) {
+        LOG_ERR("Invalid PPL parameters");
+        return E_PPL_INVALID_PARAM;
+    }
+    const JSON_Object *o = json_value_get_object(value);
+
+    ppl_params_t p;
+    if (params_parse(o, &p) != 0) {
+        json_value_free(value);
+        return E_PPL_INVALID_PARAM;
+    }
+    p.max_detections = std::min<uint32_t>(p.max_detections,
+                                          PPL_MAX_DETECTIONS);
+
+    // The decoder inherits the shared keys unless "decode" overrides them.
+    decode_config_t cfg;
+    decode_default_config(&cfg);
+    cfg.input_width = p.input_width;
+    cfg.input_height = p.input_height;
+    cfg.max_detections = p.max_detections;
+    if (p.min_threshold > 0 && p.min_threshold < 1)
+        cfg.score_threshold = p.min_threshold;
+    int err = decode_parse_config(o, &cfg);
+    json_value_free(value);
+    if (err != 0)
+        return E_PPL_INVALID_PARAM;
+    cfg.max_detections = std::min<uint32_t>(cfg.max_detections,
+                                            PPL_MAX_DETECTIONS);
+    if (decode_init(&cfg) != 0)
+        return E_PPL_INVALID_PARAM;
+    decode_config = cfg;
+    params = p;
+    annotations_scratch.reserve(PPL_MAX_DETECTIONS);
+    cascade_classes.reserve(PPL_MAX_DETECTIONS);
+    cascade_scores.reserve(PPL_MAX_DETECTIONS);
     return E_PPL_OK;
 }
 
@@ -38,60 +415,82 @@ PPL_Analyze(float *p_data, uint32_t in_size, void **pp_out_buf,
 {
     LOG_DBG("In PPL_Analyze. Size: %u", in_size);
     auto ot = output_tensor::GetOutputTensor((const void *)p_data);
-    auto data = ot->data();
-    LOG_DBG("Number of bounding boxes: %d", data->size());
-    int num_detections = data->Get(PPL_SSD_MAX_NUM_BBOXES * (1 + 4));
-    LOG_DBG("Detections: %d", num_detections);
-
-    num_detections = std::min(num_detections, PPL_MAX_DETECTIONS);
 
-    std::vector<postprocessed::DetectionAnn> v;
-    for (uint8_t i = 0; i < num_detections; ++i) {
-
-        float score = data->Get(i);
-        if (score < PPL_CONFIDENCE_THRESHOLD)
-            break;
-
-        float y_min = data->Get(PPL_SSD_MAX_NUM_BBOXES + i * 4);
-        float x_min = data->Get(PPL_SSD_MAX_NUM_BBOXES + i * 4 + 1);
-        float y_max = data->Get(PPL_SSD_MAX_NUM_BBOXES + i * 4 + 2);
-        float x_max = data->Get(PPL_SSD_MAX_NUM_BBOXES + i * 4 + 3);
-        float cls = data->Get(PPL_SSD_MAX_NUM_BBOXES * (1 + 4) + 1 + i);
-
-        y_min = MIN(1, MAX(0, y_min));
-        x_min = MIN(1, MAX(0, x_min));
-        y_max = MIN(1, MAX(0, y_max));
-        x_max = MIN(1, MAX(0, x_max));
-
-        if (y_min > y_max || x_min > x_max)
-            LOG_WARN("y_min > y_max or x_min > x_max");
+    // Keeps its capacity across frames.
+    std::vector<postprocessed::DetectionAnn> &v = annotations_scratch;
+    v.clear();
+    cascade_classes.clear();
+    cascade_scores.clear();
+    // No tensors: the inference skipped the frame. It is always passed on,
+    // without detections, for the tracker to fill in.
+    bool inferred = ot->tensors() == nullptr || ot->tensors()->size() != 0;
+    if (inferred) {
+        EPPL_RESULT_CODE res = decode_config.enabled
+                                   ? analyze_raw(ot, v)
+                                   : analyze_postprocessed(ot, v);
+        if (res != E_PPL_OK)
+            return res;
+    }
 
-        auto bbox = postprocessed::Bbox(x_min, x_max, y_min, y_max);
-        v.push_back(postprocessed::DetectionAnn(bbox, score, cls));
+    uint64_t now = now_ms();
+    upload_state *state = &upload_states[ot->stream_id() % MAX_STREAMS];
+    *p_upload_flag = !inferred || should_upload(state, v.size(), now);
+    if (!*p_upload_flag) {
+        *pp_out_buf = nullptr;
+        *p_out_size = 0;
+        return E_PPL_OK;
     }
 
-    flatbuffers::FlatBufferBuilder builder;
+    result_slot *slot = acquire_result_slot();
+    if (slot == nullptr) {
+        LOG_ERR("All PPL results are still in use");
+        return E_PPL_E_MEMORY_ERROR;
+    }
+    auto &builder = slot->builder;
     auto annotations = builder.CreateVectorOfStructs(v);
+    flatbuffers::Offset<flatbuffers::Vector<uint32_t>> classes_offset;
+    flatbuffers::Offset<flatbuffers::Vector<float>> scores_offset;
+    if (!cascade_classes.empty()) {
+        classes_offset = builder.CreateVector(cascade_classes);
+        scores_offset = builder.CreateVector(cascade_scores);
+    }
     postprocessed::DetectionBuilder postprocessed_builder(builder);
     postprocessed_builder.add_annotations(annotations);
+    // Lets consumers match the detections with their frame.
+    postprocessed_builder.add_frame_id(ot->frame_id());
+    postprocessed_builder.add_timestamp(ot->timestamp());
+    postprocessed_builder.add_stream_id(ot->stream_id());
+    postprocessed_builder.add_inferred(inferred);
+    postprocessed_builder.add_cascade_classes(classes_offset);
+    postprocessed_builder.add_cascade_scores(scores_offset);
     builder.Finish(postprocessed_builder.Finish());
     *p_out_size = builder.GetSize();
-    *pp_out_buf = (char *)malloc(*p_out_size);
-    memcpy(*pp_out_buf, builder.GetBufferPointer(), *p_out_size);
-    builder.Clear();
-    *p_upload_flag = true;
+    // Owned by the slot until PPL_ResultRelease.
+    *pp_out_buf = builder.GetBufferPointer();
+    if (inferred) {
+        state->last_empty = v.empty();
+        state->last_ms = now;
+    }
     return E_PPL_OK;
 }
 
 __attribute__((export_name("PPL_ResultRelease"))) EPPL_RESULT_CODE
 PPL_ResultRelease(void *p_result)
 {
-    return E_PPL_OK;
+    for (auto &slot : result_slots) {
+        if (slot.in_use && slot.builder.GetBufferPointer() == p_result) {
+            slot.in_use = false;
+            return E_PPL_OK;
+        }
+    }
+    LOG_WARN("PPL_ResultRelease: unknown result %p", p_result);
+    return E_PPL_INVALID_PARAM;
 }
 
 __attribute__((export_name("PPL_Finalize"))) EPPL_RESULT_CODE
 PPL_Finalize()
 {
+    decode_deinit();
     return E_PPL_OK;
 }
 
@@ -5,6 +5,7 @@
 #include <string.h>
 
 #include "evp/sdk.h"
+#include "frame_meta.h"
 #include "logger.h"
 #include "user_bridge_c.h"
 
@@ -12,6 +13,7 @@
 #define WINDOW_NAME "Default Window"
 #endif
 
+// Size of frames without metadata
 #ifndef WIDTH
 #define WIDTH 300
 #endif
@@ -22,7 +24,43 @@
 static char *module_name = "senscord_sink";
 static struct EVP_client *h;
 
-static uint64_t stream_handler = 0;
+// Created for the size of the first frame of a camera and again when it
+// changes
+struct output_stream {
+    uint64_t handler;
+    uint32_t width;
+    uint32_t height;
+};
+
+static struct output_stream streams[MAX_STREAMS];
+
+static struct output_stream *
+open_stream(uint32_t stream_id, uint32_t width, uint32_t height)
+{
+    struct output_stream *s = &streams[stream_id % MAX_STREAMS];
+    if (s->handler != 0 && width == s->width && height == s->height)
+        return s;
+    if (s->handler != 0 && senscord_ub_destroy_stream(s->handler) != 0)
+        LOG_WARN("senscord_ub_destroy_stream failed.");
+    // The first camera keeps the window name it had before there were
+    // several.
+    char name[sizeof(WINDOW_NAME) + 4];
+    if (s == &streams[0])
+        snprintf(name, sizeof(name), "%s", WINDOW_NAME);
+    else
+        snprintf(name, sizeof(name), "%s %u", WINDOW_NAME,
+                 (unsigned)(s - streams));
+    LOG_DBG("Creating stream %s of %ux%u...", name, width, height);
+    s->handler = senscord_ub_create_stream(name, width, height, width * 3,
+                                           SENSCORD_PIXEL_FORMAT_RGB24);
+    if (s->handler == 0) {
+        LOG_WARN("senscord_ub_create_stream failed.");
+        return NULL;
+    }
+    s->width = width;
+    s->height = height;
+    return s;
+}
 
 static void
 message_cb(const char *topic, const void *msgPayload, size_t msgPayloadLen,
@@ -30,7 +68,20 @@ message_cb(const char *topic, const void *msgPayload, size_t msgPayloadLen,
 {
     LOG_DBG("%s: INPUT (topic=%s, size=%zu)", module_name, topic,
              msgPayloadLen);
-    int32_t res = senscord_ub_send_data(stream_handler, (uint8_t *)msgPayload);
+    frame_meta_t meta;
+    if (!frame_meta_read(msgPayload, msgPayloadLen, &meta)) {
+        if (msgPayloadLen < WIDTH * HEIGHT * 3) {
+            LOG_WARN("Frame of %zu bytes is too small", msgPayloadLen);
+            return;
+        }
+        meta.width = WIDTH;
+        meta.height = HEIGHT;
+    }
+    struct output_stream *s =
+        open_stream(meta.stream_id, meta.width, meta.height);
+    if (s == NULL)
+        return;
+    int32_t res = senscord_ub_send_data(s->handler, (uint8_t *)msgPayload);
     if (res != 0)
         LOG_WARN("senscord_ub_send_data failed.");
 }
@@ -44,14 +95,6 @@ main(int argc, const char *argv[])
     EVP_RESULT result = EVP_setMessageCallback(h, message_cb, NULL);
     assert(result == EVP_OK);
 
-    LOG_DBG("Creating stream...");
-    stream_handler = senscord_ub_create_stream(
-        WINDOW_NAME, WIDTH, HEIGHT, WIDTH * 3, SENSCORD_PIXEL_FORMAT_RGB24);
-    if (stream_handler == 0) {
-        LOG_DBG("senscord_ub_create_stream failed.");
-        return -1;
-    }
-
     for (;;) {
         result = EVP_processEvent(h, 1000);
         if (result == EVP_SHOULDEXIT) {
@@ -60,11 +103,16 @@ main(int argc, const char *argv[])
         }
     }
 
-    res = senscord_ub_destroy_stream(stream_handler);
-    if (res != 0) {
-        LOG_DBG("senscord_ub_destroy_stream failed.");
-        return -1;
+    for (int i = 0; i < MAX_STREAMS; ++i) {
+        if (streams[i].handler == 0)
+            continue;
+        if (senscord_ub_destroy_stream(streams[i].handler) != 0) {
+            LOG_DBG("senscord_ub_destroy_stream failed.");
+            res = -1;
+        }
     }
+    if (res != 0)
+        return -1;
 
     return 0;
 }
@@ -1,5 +1,6 @@
 #include <assert.h>
 #include <inttypes.h>
+#include <stdatomic.h>
 #include <stdbool.h>
 #include <stdint.h>
 #include <stdio.h>
@@ -9,36 +10,126 @@
 #include <time.h>
 
 #include "evp/sdk.h"
+#include "frame_meta.h"
+#include "image_convert.h"
 #include "logger.h"
+#include "parson.h"
 #include "senscord/c_api/senscord_c_api.h"
 #include "senscord_wasm.h"
-#include <opencv2/imgproc/imgproc_c.h>
 
 #define OUTPUT_TOPIC1 "input_tensor"
 #define OUTPUT_TOPIC2 "image"
 #define INPUT_TOPIC   "give_input_tensor"
 
+// Frame size until the consumer asks for another one
 #ifndef WIDTH
 #define WIDTH 300
 #endif
 #ifndef HEIGHT
 #define HEIGHT 300
 #endif
+// Largest frame side a consumer may ask for
+#define MAX_FRAME_SIDE 2048
+
+// Largest share weight of a stream
+#define MAX_WEIGHT 100
+// Output buffers in flight at once; each is shared by both output topics.
+#define FRAME_POOL_SIZE 4
+// Upper bound on frames the consumer may have outstanding.
+#define MAX_CREDITS 8
+// How long the main loop waits for EVP events between frame checks.
+#define EVENT_POLL_MSEC 5
+// Fallback wait for a frame when the stream has no frame callback.
+#define GET_FRAME_WAIT_MSEC 10
+
+// The sensor is slowed down to the rate the consumer takes frames at,
+// measured over this period.
+#define RATE_CONTROL_MSEC 2000
+// Sensor rate over the consumer rate, so that a fresh frame is ready when
+// the next credit comes
+#define RATE_HEADROOM 1.25f
+#define MIN_FRAME_RATE 1.0f
+// Changes smaller than this fraction of the current rate are not applied
+#define RATE_HYSTERESIS 0.2f
+// Largest skip ratio when the sensor has no frame rate property
+#define MAX_SKIP_RATE 30
 
 static const char *module_name = "senscord_source";
 static struct EVP_client *h;
 
-// "webcam_image_stream.0" or "raspicam_image_stream.0"
-static char *stream_key = NULL;
+// How the capture rate is controlled, found out when it is first changed
+enum rate_control {
+    RATE_CONTROL_NONE,
+    RATE_CONTROL_FRAME_RATE,
+    RATE_CONTROL_SKIP_FRAME,
+};
+
+// One SensCord stream. Its index in `cameras` is the stream id published
+// with its frames.
+struct camera {
+    // "webcam_image_stream.0" or "raspicam_image_stream.0"
+    char *key;
+    senscord_stream_t stream;
+    bool is_open;
+
+    uint32_t width;
+    uint32_t height;
+    uint32_t stride;
+    char format[SENSCORD_PIXEL_FORMAT_LENGTH];
+    // Frame size before any crop; the ROI is given in its pixels
+    uint32_t full_width;
+    uint32_t full_height;
+
+    // Region of interest set by the "roi" RPC, zero width for the whole
+    // frame
+    struct senscord_image_crop_property_t roi;
+    bool roi_changed;
+    // Cleared once the sensor rejects a crop
+    bool can_crop;
+    bool cropped;
+    // Cut out of each frame while it is copied, when the sensor does not
+    // crop; zero width for none
+    struct senscord_image_crop_property_t copy_rect;
+
+    // Frames signalled by the SensCord frame callback and not yet fetched.
+    // The callback may run on another thread, so it is atomic.
+    _Atomic uint32_t frames_arrived;
+    bool has_frame_callback;
+    // Set when polling the stream found no frame, so that the other
+    // streams get their turn first
+    bool poll_missed;
+
+    // Share of the frames relative to the other streams, and frames
+    // published so far
+    uint32_t weight;
+    uint64_t served;
+
+    enum rate_control rate_control;
+    // Frame rate of the sensor as it was configured, and as it is now
+    float sensor_fps;
+    float capture_fps;
+    // Frames published in the current rate control window
+    uint32_t window_frames;
+};
+
+static struct camera cameras[MAX_STREAMS];
+static uint32_t num_cameras = 0;
+static bool configured = false;
 static senscord_core_t core = 0;
-static senscord_stream_t stream = 0;
 
-static uint32_t cam_width = 0;
-static uint32_t cam_height = 0;
-static bool is_yuv = false;
-static bool do_resize = false;
+// Size of the published frames, requested by the consumer with its credits
+static uint32_t out_width = WIDTH;
+static uint32_t out_height = HEIGHT;
+static image_fit_t fit = IMAGE_FIT_STRETCH;
+
+// Frames the consumer has asked for but not received yet. Each
+// give_input_tensor message grants more; each published frame spends one.
+static uint32_t credits = 0;
 
-static bool ready_receive = false;
+static uint64_t rate_window_start = 0;
+// Set when a converted frame waited for a credit in the current window,
+// that is when the consumer, not the sensors, set the pace
+static bool rate_window_waited = false;
 
 struct senscord_raw_data_wasm_t {
     uint32_t address;
@@ -47,34 +138,90 @@ struct senscord_raw_data_wasm_t {
     uint64_t timestamp;
 };
 
-struct send_message_cb_data {
-    char *topic;
-    char *payload;
+// A converted RGB frame. The same buffer is published on every output topic
+// and goes back to the pool once the last send completes.
+struct frame_buffer {
+    uint32_t refs;
+    uint8_t *data;
+    size_t capacity;
+    uint32_t width;
+    uint32_t height;
+    uint32_t stream_id;
+    uint64_t timestamp;
 };
 
+// Shared by all the streams, as are the staging buffer and the prefetch
+// slot: frames are captured and converted one at a time.
+static struct frame_buffer frame_pool[FRAME_POOL_SIZE];
+// Next frame, captured and converted while the consumer is busy.
+static struct frame_buffer *prefetched = NULL;
+
+// A frame fetched from a stream and not released yet. Its pixels stay in
+// host memory until it is converted.
+struct raw_frame {
+    struct camera *cam;
+    senscord_frame_t frame;
+    struct senscord_raw_data_t rawdata;
+};
+// Newest frame captured while the consumer had no credit, NULL cam for
+// none: converted only if it is still the newest when a credit comes.
+static struct raw_frame held = {.cam = NULL};
+
+// Id of the last published frame, over all the streams
+static uint32_t frame_id = 0;
+
+// Reused copy of the sensor's raw frame; grown on demand, never shrunk.
+static uint8_t *staging = NULL;
+static uint32_t staging_size = 0;
+
+static struct frame_buffer *
+frame_buffer_acquire()
+{
+    for (int i = 0; i < FRAME_POOL_SIZE; ++i) {
+        struct frame_buffer *fb = &frame_pool[i];
+        if (fb->refs != 0)
+            continue;
+        // Grown when the consumer asks for larger frames, never shrunk.
+        size_t size = frame_meta_frame_size(out_width, out_height);
+        if (size > fb->capacity) {
+            uint8_t *p = realloc(fb->data, size);
+            if (p == NULL)
+                return NULL;
+            fb->data = p;
+            fb->capacity = size;
+        }
+        fb->width = out_width;
+        fb->height = out_height;
+        fb->refs = 1;
+        return fb;
+    }
+    return NULL;
+}
+
+static void
+frame_buffer_release(struct frame_buffer *fb)
+{
+    assert(fb->refs > 0);
+    fb->refs--;
+}
+
 static void
 send_message_cb(EVP_MESSAGE_SENT_CALLBACK_REASON reason, void *userData)
 {
-    struct send_message_cb_data *d = userData;
-    assert(d != NULL);
-    assert(d->topic != NULL);
-    assert(d->payload != NULL);
-    free(d->topic);
-    free(d->payload);
-    free(d);
+    struct frame_buffer *fb = userData;
+    assert(fb != NULL);
+    frame_buffer_release(fb);
 }
 
 static void
-send_message(char *topic, char *rgbdata, uint32_t outsize)
+send_message(const char *topic, struct frame_buffer *fb, uint32_t outsize)
 {
     LOG_DBG("Sending message to topic %s with size %d", topic, outsize);
-    struct send_message_cb_data *d = malloc(sizeof(*d));
-    assert(d != NULL);
-    d->topic = strdup(topic);
-    assert(d->topic != NULL);
-    d->payload = rgbdata;
+    fb->refs++;
     EVP_RESULT result =
-        EVP_sendMessage(h, d->topic, d->payload, outsize, send_message_cb, d);
+        EVP_sendMessage(h, topic, fb->data, outsize, send_message_cb, fb);
+    if (result != EVP_OK)
+        frame_buffer_release(fb);
     assert(result == EVP_OK);
 }
 
@@ -88,12 +235,12 @@ print_senscord_error(struct senscord_status_t status)
 }
 
 int32_t
-get_and_update_image_property()
+get_and_update_image_property(struct camera *cam)
 {
     int32_t ret = 0;
     struct senscord_image_property_t image_property;
     ret =
-        senscord_stream_get_property(stream, SENSCORD_IMAGE_PROPERTY_KEY,
+        senscord_stream_get_property(cam->stream, SENSCORD_IMAGE_PROPERTY_KEY,
                                      &image_property, sizeof(image_property));
     LOG_INFO("senscord_stream_get_property(): ret=%d", ret);
     if (ret != 0) {
@@ -104,62 +251,251 @@ get_and_update_image_property()
     LOG_DBG("image_property width = %d", image_property.width);
     LOG_DBG("image_property stride_bytes = %d", image_property.stride_bytes);
     LOG_DBG("image_property pixel_format = %s", image_property.pixel_format);
-    do_resize =
-        image_property.height != HEIGHT | image_property.width != WIDTH;
-    is_yuv = strcmp(image_property.pixel_format, "image_nv16") == 0;
 
-    cam_height = image_property.height;
-    cam_width = image_property.width;
+    cam->height = image_property.height;
+    cam->width = image_property.width;
+    cam->stride = image_property.stride_bytes;
+    strncpy(cam->format, image_property.pixel_format,
+            sizeof(cam->format) - 1);
     return 0;
 }
 
-void
-convert_nv16_to_rgb(const uint8_t *nv16_data, uint8_t *rgb_data)
-{
-    int size = cam_width * cam_height;
-    int rgb_data_size = HEIGHT * WIDTH * 3;
-
-    LOG_DBG("is_yuv = %d, do-resize = %d", is_yuv, do_resize);
-    CvMat *mat2 = NULL;
-    if (is_yuv) {
-        uint8_t *yuv = (uint8_t *)malloc(size * 2);
-        for (int i = 0; i < size; ++i) {
-            yuv[i * 2] = nv16_data[i];
-            yuv[i * 2 + 1] = nv16_data[size + i];
-        }
-
-        CvMat *mat1 = cvCreateMat(cam_height, cam_width, CV_8UC2);
-        cvSetData(mat1, yuv, CV_AUTOSTEP);
-        mat2 = cvCreateMat(cam_height, cam_width, CV_8UC3);
-        cvCvtColor(mat1, mat2, CV_YUV2BGR_YUYV);
-        cvCvtColor(mat2, mat2, CV_BGR2RGB);
-        cvReleaseMat(&mat1);
-        free(yuv);
+// Bytes per pixel in each plane and number of planes of the formats
+// image_src_init() knows
+static int
+format_layout(const char *format, uint32_t *bytes_per_pixel,
+              uint32_t *planes)
+{
+    if (strcmp(format, "image_nv16") == 0) {
+        // Y plane, then interleaved CbCr at the same stride
+        *bytes_per_pixel = 1;
+        *planes = 2;
+    } else if (strcmp(format, "image_rgb24") == 0) {
+        *bytes_per_pixel = 3;
+        *planes = 1;
     } else {
-        mat2 = cvCreateMat(cam_height, cam_width, CV_8UC3);
-        cvSetData(mat2, (void *)nv16_data, CV_AUTOSTEP);
+        return -1;
+    }
+    return 0;
+}
+
+// Clip the ROI to a width x height frame, with the left edge and width
+// even so that NV16 CbCr pairs stay whole. Zero width if nothing is left.
+static struct senscord_image_crop_property_t
+roi_clip(const struct camera *cam, uint32_t width, uint32_t height)
+{
+    struct senscord_image_crop_property_t r = cam->roi;
+    r.left &= ~1u;
+    if (r.left >= width || r.top >= height) {
+        r.width = 0;
+        return r;
     }
+    if (r.width > width - r.left)
+        r.width = width - r.left;
+    if (r.height > height - r.top)
+        r.height = height - r.top;
+    r.width &= ~1u;
+    if (r.height == 0)
+        r.width = 0;
+    return r;
+}
 
-    if (do_resize) {
-        CvMat *mat3 = cvCreateMat(HEIGHT, WIDTH, CV_8UC3);
-        cvResize(mat2, mat3, CV_INTER_NN);
+static int
+set_sensor_crop(struct camera *cam,
+                const struct senscord_image_crop_property_t *crop)
+{
+    int32_t ret = senscord_stream_set_property(
+        cam->stream, SENSCORD_IMAGE_CROP_PROPERTY_KEY, crop, sizeof(*crop));
+    LOG_DBG("senscord_stream_set_property(crop): ret=%d", ret);
+    if (ret != 0)
+        print_senscord_error(senscord_get_last_error());
+    return ret;
+}
 
-        cvGetData(mat3, rgb_data, rgb_data_size);
-        cvReleaseMat(&mat3);
-    } else {
-        cvGetData(mat2, rgb_data, rgb_data_size);
+// Push the ROI to the sensor, so that only the ROI is transferred. Sensors
+// that cannot crop send whole frames and the ROI is cut out while copying.
+static void
+apply_roi(struct camera *cam)
+{
+    cam->roi_changed = false;
+    struct senscord_image_crop_property_t r =
+        roi_clip(cam, cam->full_width, cam->full_height);
+    struct senscord_image_crop_property_t full = {
+        .left = 0,
+        .top = 0,
+        .width = cam->full_width,
+        .height = cam->full_height};
+    const struct senscord_image_crop_property_t *crop =
+        r.width != 0 ? &r : &full;
+
+    memset(&cam->copy_rect, 0, sizeof(cam->copy_rect));
+    if (cam->can_crop && (r.width != 0 || cam->cropped)) {
+        if (set_sensor_crop(cam, crop) == 0) {
+            cam->cropped = r.width != 0;
+            LOG_INFO("%s: sensor crop %ux%u+%u+%u", cam->key, crop->width,
+                     crop->height, crop->left, crop->top);
+            get_and_update_image_property(cam);
+            return;
+        }
+        LOG_WARN("%s: the sensor cannot crop, cropping while copying",
+                 cam->key);
+        cam->can_crop = false;
+        if (cam->cropped && set_sensor_crop(cam, &full) == 0)
+            cam->cropped = false;
+        get_and_update_image_property(cam);
     }
-    cvReleaseMat(&mat2);
+    if (cam->cropped)
+        return;
+    cam->copy_rect = roi_clip(cam, cam->width, cam->height);
+    if (cam->copy_rect.width != 0)
+        LOG_INFO("%s: copy crop %ux%u+%u+%u", cam->key,
+                 cam->copy_rect.width, cam->copy_rect.height,
+                 cam->copy_rect.left, cam->copy_rect.top);
+}
+
+// Parse "[stream] left top width height" in pixels of the uncropped frame,
+// for one stream or, without the stream id, for all of them. Anything
+// else selects the whole frames again.
+static void
+set_roi(const char *params)
+{
+    unsigned v[5];
+    int n = params == NULL ? 0
+                           : sscanf(params, "%u %u %u %u %u", &v[0], &v[1],
+                                    &v[2], &v[3], &v[4]);
+    uint32_t first = 0, last = MAX_STREAMS - 1;
+    if (n == 5) {
+        if (v[0] >= MAX_STREAMS) {
+            LOG_WARN("No stream %u", v[0]);
+            return;
+        }
+        first = last = v[0];
+    }
+    const unsigned *rect = n == 5 ? &v[1] : &v[0];
+    for (uint32_t i = first; i <= last; ++i) {
+        struct camera *cam = &cameras[i];
+        if (n >= 4) {
+            cam->roi.left = rect[0];
+            cam->roi.top = rect[1];
+            cam->roi.width = rect[2];
+            cam->roi.height = rect[3];
+        } else {
+            memset(&cam->roi, 0, sizeof(cam->roi));
+        }
+        cam->roi_changed = true;
+    }
+}
+
+static int
+convert_nv16_to_rgb(const struct camera *cam, const uint8_t *nv16_data,
+                    struct frame_buffer *fb)
+{
+    image_src_t src;
+    int ret;
+    if (cam->copy_rect.width != 0)
+        ret = image_src_init(&src, nv16_data, cam->copy_rect.width,
+                             cam->copy_rect.height, 0, cam->format);
+    else
+        ret = image_src_init(&src, nv16_data, cam->width, cam->height,
+                             cam->stride, cam->format);
+    if (ret != 0) {
+        LOG_ERR("Unsupported pixel format %s", cam->format);
+        return -1;
+    }
+    image_convert_rgb24_fit(&src, fb->data, fb->width, fb->height, fit);
     LOG_INFO("Conversion to rgb done");
+    return 0;
+}
+
+static uint8_t *
+staging_reserve(uint32_t size)
+{
+    if (size > staging_size) {
+        uint8_t *p = realloc(staging, size);
+        if (p == NULL)
+            return NULL;
+        staging = p;
+        staging_size = size;
+    }
+    return staging;
+}
+
+// Copy `rows` rows of `bytes` bytes, `stride` apart in host memory, into a
+// packed buffer: a single copy when the rows are contiguous.
+static void
+copy_rows(uint8_t *dst, uint64_t src, uint32_t stride, uint32_t bytes,
+          uint32_t rows)
+{
+    if (bytes == stride) {
+        senscord_memcpy((uint32_t)dst, src, bytes * rows);
+        return;
+    }
+    for (uint32_t y = 0; y < rows; ++y)
+        senscord_memcpy((uint32_t)(dst + y * bytes),
+                        src + (uint64_t)y * stride, bytes);
+}
+
+// Copy the frame, or only copy_rect of it packed, into the staging buffer.
+// Frames not of the current geometry, such as those queued before an ROI
+// change resized the stream, are dropped.
+static uint8_t *
+copy_frame(const struct camera *cam,
+           const struct senscord_raw_data_t *rawdata)
+{
+    const struct senscord_image_crop_property_t *rect = &cam->copy_rect;
+    uint32_t bpp, planes;
+    if (format_layout(cam->format, &bpp, &planes) != 0) {
+        LOG_ERR("Unsupported pixel format %s", cam->format);
+        return NULL;
+    }
+    uint32_t stride = cam->stride != 0 ? cam->stride : cam->width * bpp;
+    if ((uint64_t)stride * cam->height * planes != rawdata->size) {
+        LOG_WARN("Frame of %zu bytes is not %ux%u, dropping it",
+                 rawdata->size, cam->width, cam->height);
+        return NULL;
+    }
+    if (rect->width != 0) {
+        uint32_t bytes = rect->width * bpp;
+        uint32_t plane_size = bytes * rect->height;
+        uint8_t *raw = staging_reserve(plane_size * planes);
+        if (raw == NULL)
+            return NULL;
+        uint64_t src = (uint64_t)rawdata->address +
+                       (uint64_t)rect->top * stride + rect->left * bpp;
+        for (uint32_t p = 0; p < planes; ++p) {
+            copy_rows(raw + p * plane_size, src, stride, bytes,
+                      rect->height);
+            src += (uint64_t)stride * cam->height;
+        }
+        return raw;
+    }
+    uint8_t *raw = staging_reserve(rawdata->size);
+    if (raw != NULL)
+        senscord_memcpy((uint32_t)raw, (uint64_t)rawdata->address,
+                        rawdata->size);
+    return raw;
 }
 
 static int
-get_frame(unsigned char **rgbdata)
+release_frame(struct raw_frame *rf)
+{
+    int32_t ret = senscord_stream_release_frame(rf->cam->stream, rf->frame);
+    LOG_DBG("senscord_stream_release_frame(): ret=%d", ret);
+    rf->cam = NULL;
+    if (ret != 0) {
+        print_senscord_error(senscord_get_last_error());
+        return -1;
+    }
+    return 0;
+}
+
+static int
+fetch_frame(struct camera *cam, int32_t timeout_msec, struct raw_frame *rf)
 {
     int32_t ret = 0;
 
     senscord_frame_t frame;
-    ret = senscord_stream_get_frame(stream, &frame, 3000);
+    ret = senscord_stream_get_frame(cam->stream, &frame, timeout_msec);
     LOG_DBG("senscord_stream_get_frame(): ret=%d\n", ret);
     if (ret != 0) {
         print_senscord_error(senscord_get_last_error());
@@ -174,36 +510,203 @@ get_frame(unsigned char **rgbdata)
     ret = senscord_frame_get_channel(frame, 0, &channel);
     LOG_DBG("senscord_frame_get_channel(): ret=%d, index=%u", ret, 0);
 
-    struct senscord_raw_data_t rawdata;
-    char format[64] = {0};
-    ///rawdata.type = (uint32_t)format;
-    ret = senscord_channel_get_raw_data(channel, &rawdata);
+    ret = senscord_channel_get_raw_data(channel, &rf->rawdata);
     LOG_DBG("senscord_channel_get_raw_data(): ret=%d", ret);
     if (ret != 0) {
         print_senscord_error(senscord_get_last_error());
+        senscord_stream_release_frame(cam->stream, frame);
         return -1;
     }
 
     LOG_DBG("rawdata address = %" PRIu64 " size = %zu timestamp = %" PRIu64
             " type = %s",
-            rawdata.address, rawdata.size, rawdata.timestamp,
-            (char *)rawdata.type);
+            rf->rawdata.address, rf->rawdata.size, rf->rawdata.timestamp,
+            (char *)rf->rawdata.type);
+    rf->cam = cam;
+    rf->frame = frame;
+    return 0;
+}
 
-    uint8_t *nv16_data = (uint8_t *)malloc(rawdata.size);
-    senscord_memcpy((uint32_t)nv16_data, (uint64_t)rawdata.address,
-                    rawdata.size);
+// Convert `rf` into `fb` and release it.
+static int
+convert_frame(struct raw_frame *rf, struct frame_buffer *fb)
+{
+    // The frame lives in host memory that WASM cannot address, so it is
+    // copied once into the reused staging buffer and converted from there.
+    int converted = -1;
+    uint8_t *raw = copy_frame(rf->cam, &rf->rawdata);
+    if (raw != NULL) {
+        converted = convert_nv16_to_rgb(rf->cam, raw, fb);
+        fb->timestamp = rf->rawdata.timestamp;
+        fb->stream_id = rf->cam - cameras;
+    } else {
+        LOG_ERR("Cannot copy the frame of %zu bytes", rf->rawdata.size);
+    }
 
-    *rgbdata = (unsigned char *)malloc(640 * 480 * 3);
-    convert_nv16_to_rgb(nv16_data, *rgbdata);
-    free(nv16_data);
+    if (release_frame(rf) != 0)
+        return -1;
+    return converted;
+}
 
-    ret = senscord_stream_release_frame(stream, frame);
-    LOG_DBG("senscord_stream_release_frame(): ret=%d", ret);
-    if (ret != 0) {
+static uint64_t
+now_ms()
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000 + ts.tv_nsec / 1000000;
+}
+
+static void
+init_rate_control(struct camera *cam)
+{
+    struct senscord_frame_rate_property_t rate;
+    int32_t ret = senscord_stream_get_property(
+        cam->stream, SENSCORD_FRAME_RATE_PROPERTY_KEY, &rate, sizeof(rate));
+    LOG_DBG("senscord_stream_get_property(frame_rate): ret=%d", ret);
+    if (ret != 0 || rate.num == 0 || rate.denom == 0) {
+        LOG_INFO("%s: unknown frame rate, capturing at full rate",
+                 cam->key);
+        return;
+    }
+    cam->sensor_fps = (float)rate.num / rate.denom;
+    cam->capture_fps = cam->sensor_fps;
+    cam->rate_control = RATE_CONTROL_FRAME_RATE;
+    LOG_INFO("%s: frame rate %.2f", cam->key, cam->sensor_fps);
+}
+
+static int
+set_skip_rate(struct camera *cam, uint32_t skip)
+{
+    struct senscord_skip_frame_property_t property = {.rate = skip};
+    int32_t ret = senscord_stream_set_property(
+        cam->stream, SENSCORD_SKIP_FRAME_PROPERTY_KEY, &property,
+        sizeof(property));
+    LOG_DBG("senscord_stream_set_property(skip_frame): ret=%d", ret);
+    return ret;
+}
+
+// Program the sensor for `fps`, with the frame rate property if it takes
+// it, otherwise by skipping frames. Returns the rate actually set.
+static float
+set_capture_rate(struct camera *cam, float fps)
+{
+    if (cam->rate_control == RATE_CONTROL_FRAME_RATE) {
+        // Hundredths of a frame per second
+        struct senscord_frame_rate_property_t rate = {
+            .num = (uint32_t)(fps * 100 + 0.5f), .denom = 100};
+        int32_t ret = senscord_stream_set_property(
+            cam->stream, SENSCORD_FRAME_RATE_PROPERTY_KEY, &rate,
+            sizeof(rate));
+        LOG_DBG("senscord_stream_set_property(frame_rate): ret=%d", ret);
+        if (ret == 0)
+            return fps;
+        LOG_INFO("%s: the frame rate is fixed, skipping frames instead",
+                 cam->key);
+        cam->rate_control = RATE_CONTROL_SKIP_FRAME;
+    }
+    if (cam->rate_control == RATE_CONTROL_SKIP_FRAME) {
+        uint32_t skip = (uint32_t)(cam->sensor_fps / fps + 0.5f);
+        skip = skip < 1 ? 1 : skip > MAX_SKIP_RATE ? MAX_SKIP_RATE : skip;
+        if (set_skip_rate(cam, skip) == 0)
+            return cam->sensor_fps / skip;
+        LOG_WARN("%s: cannot skip frames, capturing at full rate",
+                 cam->key);
         print_senscord_error(senscord_get_last_error());
-        return -1;
+        cam->rate_control = RATE_CONTROL_NONE;
     }
-    return 0;
+    return cam->sensor_fps;
+}
+
+// Once per window, set the capture rate of each stream to what the
+// consumer took from it plus some headroom. If no frame had to wait for a
+// credit, the consumer could have taken more, so the rate is doubled
+// instead, up to the sensor's.
+static void
+update_capture_rates()
+{
+    uint64_t now = now_ms();
+    uint64_t elapsed = now - rate_window_start;
+    if (elapsed < RATE_CONTROL_MSEC)
+        return;
+
+    for (uint32_t i = 0; i < num_cameras; ++i) {
+        struct camera *cam = &cameras[i];
+        if (!cam->is_open || cam->rate_control == RATE_CONTROL_NONE)
+            continue;
+        float target;
+        if (rate_window_waited)
+            target = cam->window_frames * 1000.0f / elapsed * RATE_HEADROOM;
+        else
+            target = cam->capture_fps * 2;
+        if (target < MIN_FRAME_RATE)
+            target = MIN_FRAME_RATE;
+        if (target > cam->sensor_fps)
+            target = cam->sensor_fps;
+
+        float change = target - cam->capture_fps;
+        if (change < 0)
+            change = -change;
+        if (change > cam->capture_fps * RATE_HYSTERESIS ||
+            (target == cam->sensor_fps &&
+             cam->capture_fps != cam->sensor_fps)) {
+            cam->capture_fps = set_capture_rate(cam, target);
+            LOG_INFO("%s: capture rate %.2f for %u frames in %" PRIu64
+                     " ms",
+                     cam->key, cam->capture_fps, cam->window_frames,
+                     elapsed);
+        }
+        cam->window_frames = 0;
+    }
+    rate_window_start = now;
+    rate_window_waited = false;
+}
+
+// Leave the sensor as it was found, for whoever opens it next.
+static void
+restore_capture_rate(struct camera *cam)
+{
+    if (cam->capture_fps == cam->sensor_fps)
+        return;
+    if (cam->rate_control == RATE_CONTROL_FRAME_RATE)
+        set_capture_rate(cam, cam->sensor_fps);
+    else if (cam->rate_control == RATE_CONTROL_SKIP_FRAME)
+        set_skip_rate(cam, 1);
+}
+
+static void
+set_output_size(uint32_t width, uint32_t height)
+{
+    if (width == out_width && height == out_height)
+        return;
+    if (width == 0 || height == 0 || width > MAX_FRAME_SIDE ||
+        height > MAX_FRAME_SIDE) {
+        LOG_WARN("Ignoring frame size %ux%u", width, height);
+        return;
+    }
+    LOG_INFO("Frame size %ux%u", width, height);
+    out_width = width;
+    out_height = height;
+}
+
+// give_input_tensor carries the number of frames granted as decimal text,
+// optionally followed by the frame size the consumer wants, "2 320x320".
+// An empty message is the original one-frame request.
+static uint32_t
+parse_credits(const void *payload, size_t len)
+{
+    if (len == 0)
+        return 1;
+
+    char buf[32];
+    size_t n = len < sizeof(buf) - 1 ? len : sizeof(buf) - 1;
+    memcpy(buf, payload, n);
+    buf[n] = '\0';
+    char *end;
+    uint32_t credits = (uint32_t)strtoul(buf, &end, 10);
+    unsigned width, height;
+    if (sscanf(end, " %ux%u", &width, &height) == 2)
+        set_output_size(width, height);
+    return credits;
 }
 
 static void
@@ -212,22 +715,208 @@ message_cb(const char *topic, const void *msgPayload, size_t msgPayloadLen,
 {
     LOG_INFO("%s: INPUT (topic=%s, size=%zu)", module_name, topic,
              msgPayloadLen);
-    if (strcmp(INPUT_TOPIC, topic) == 0)
-        ready_receive = true;
+    if (strcmp(INPUT_TOPIC, topic) == 0) {
+        credits += parse_credits(msgPayload, msgPayloadLen);
+        if (credits > MAX_CREDITS)
+            credits = MAX_CREDITS;
+        LOG_DBG("credits = %u", credits);
+    }
 }
 
 static void
-send_frame()
+frame_received_cb(senscord_stream_t s, void *private_data)
+{
+    struct camera *cam = private_data;
+    atomic_fetch_add(&cam->frames_arrived, 1);
+}
+
+// Of the streams with a frame to fetch, the one that has had the fewest
+// frames for its weight: round robin when the weights are equal. Streams
+// without a frame callback are polled in turn.
+static struct camera *
+next_camera()
 {
-    unsigned char *buf = NULL;
-    get_frame(&buf);
+    for (int pass = 0; pass < 2; ++pass) {
+        struct camera *best = NULL;
+        bool missed = false;
+        for (uint32_t i = 0; i < num_cameras; ++i) {
+            struct camera *cam = &cameras[i];
+            if (!cam->is_open)
+                continue;
+            bool idle = cam->has_frame_callback
+                            ? atomic_load(&cam->frames_arrived) == 0
+                            : cam->poll_missed;
+            if (idle) {
+                missed |= cam->poll_missed;
+                continue;
+            }
+            if (best == NULL ||
+                cam->served * best->weight < best->served * cam->weight)
+                best = cam;
+        }
+        if (best != NULL || !missed)
+            return best;
+        // Every polled stream came up empty last time: poll them again.
+        for (uint32_t i = 0; i < num_cameras; ++i)
+            cameras[i].poll_missed = false;
+    }
+    return NULL;
+}
+
+// Fetch the next frame of the stream whose turn it is. Returns -1 if there
+// is none.
+static int
+fetch_next_frame(struct raw_frame *rf)
+{
+    struct camera *cam = next_camera();
+    if (cam == NULL)
+        return -1;
+
+    int32_t timeout = cam->has_frame_callback ? SENSCORD_TIMEOUT_POLLING
+                                              : GET_FRAME_WAIT_MSEC;
+    int ret = fetch_frame(cam, timeout, rf);
+    if (ret != 0)
+        cam->poll_missed = !cam->has_frame_callback;
+    // Only this loop takes frames off the count, so it stays above zero
+    // between the load and the decrement.
+    if (atomic_load(&cam->frames_arrived) > 0)
+        atomic_fetch_sub(&cam->frames_arrived, 1);
+    return ret;
+}
 
-    uint32_t size = WIDTH * HEIGHT * 3;
-    char *buf_aux = (char *)malloc(size);
-    memcpy(buf_aux, buf, size);
-    send_message(OUTPUT_TOPIC1, (char *)buf, size);
-    send_message(OUTPUT_TOPIC2, buf_aux, size);
-    ready_receive = false;
+// Convert the held frame, or else the next one, into the prefetch slot, in
+// place of the frame there if any.
+static void
+prefetch_frame()
+{
+    struct frame_buffer *fb = frame_buffer_acquire();
+    if (fb == NULL) {
+        LOG_WARN("No free frame buffer, retrying later");
+        return;
+    }
+
+    struct raw_frame rf = held;
+    held.cam = NULL;
+    if (rf.cam == NULL && fetch_next_frame(&rf) != 0) {
+        frame_buffer_release(fb);
+        return;
+    }
+    if (convert_frame(&rf, fb) == 0) {
+        if (prefetched != NULL)
+            frame_buffer_release(prefetched);
+        prefetched = fb;
+    } else {
+        frame_buffer_release(fb);
+    }
+}
+
+// Fetch the next frame in place of the held one, without converting it.
+static void
+hold_frame()
+{
+    struct raw_frame rf;
+    if (fetch_next_frame(&rf) != 0)
+        return;
+    if (held.cam != NULL)
+        release_frame(&held);
+    held = rf;
+}
+
+// Keep one converted frame ready and publish it as soon as the consumer has
+// a credit, so capture and conversion overlap with inference downstream.
+// While the consumer has no credit, newer frames are held unconverted, and
+// the newest one takes the place of the ready frame when a credit comes,
+// so each frame published is converted at most twice and is at most one
+// capture old.
+static void
+pump_frames()
+{
+    // Converted before the consumer asked for another size
+    if (prefetched != NULL && (prefetched->width != out_width ||
+                               prefetched->height != out_height)) {
+        frame_buffer_release(prefetched);
+        prefetched = NULL;
+    }
+    if (prefetched == NULL || (credits > 0 && held.cam != NULL))
+        prefetch_frame();
+    else if (credits == 0)
+        hold_frame();
+
+    if (prefetched != NULL && credits > 0) {
+        // Numbered when published, so ids have no gaps from dropped frames.
+        if (++frame_id == 0)
+            frame_id = 1;
+        frame_meta_t meta = {.magic = FRAME_META_MAGIC,
+                             .frame_id = frame_id,
+                             .timestamp = prefetched->timestamp,
+                             .width = prefetched->width,
+                             .height = prefetched->height,
+                             .stream_id = prefetched->stream_id};
+        frame_meta_write(prefetched->data, &meta);
+        uint32_t size =
+            frame_meta_frame_size(prefetched->width, prefetched->height);
+        send_message(OUTPUT_TOPIC1, prefetched, size);
+        send_message(OUTPUT_TOPIC2, prefetched, size);
+        struct camera *cam = &cameras[prefetched->stream_id];
+        cam->served++;
+        cam->window_frames++;
+        frame_buffer_release(prefetched);
+        prefetched = NULL;
+        credits--;
+    } else if (prefetched != NULL) {
+        rate_window_waited = true;
+    }
+}
+
+static void
+add_camera(const char *key, double weight)
+{
+    if (key == NULL || num_cameras == MAX_STREAMS) {
+        LOG_WARN("Ignoring stream %s", key != NULL ? key : "(null)");
+        return;
+    }
+    char *copy = strdup(key);
+    if (copy == NULL)
+        return;
+    struct camera *cam = &cameras[num_cameras++];
+    cam->key = copy;
+    cam->weight = weight < 1            ? 1
+                  : weight > MAX_WEIGHT ? MAX_WEIGHT
+                                        : (uint32_t)weight;
+    cam->can_crop = true;
+}
+
+// Either a single stream key, as before there were several, or a JSON
+// object {"streams": [...]} whose entries are stream keys or objects
+// {"key": "...", "weight": 2}.
+static void
+configure(const char *params)
+{
+    if (configured) {
+        LOG_WARN("The streams are already configured");
+        return;
+    }
+    JSON_Value *value = json_parse_string(params);
+    JSON_Array *streams =
+        json_object_get_array(json_value_get_object(value), "streams");
+    if (streams == NULL) {
+        add_camera(params, 1);
+    } else {
+        size_t count = json_array_get_count(streams);
+        for (size_t i = 0; i < count; ++i) {
+            JSON_Object *o = json_array_get_object(streams, i);
+            if (o == NULL) {
+                add_camera(json_array_get_string(streams, i), 1);
+                continue;
+            }
+            double weight = 1;
+            if (json_object_has_value_of_type(o, "weight", JSONNumber))
+                weight = json_object_get_number(o, "weight");
+            add_camera(json_object_get_string(o, "key"), weight);
+        }
+    }
+    json_value_free(value);
+    configured = num_cameras > 0;
 }
 
 void
@@ -236,12 +925,80 @@ rpc_callback(EVP_RPC_ID id, const char *methodName, const char *params,
 {
     LOG_DBG("RPC: methodName=%s params=%s", methodName, params);
     if (strcmp(methodName, "config") == 0) {
-        stream_key = strdup(params);
+        configure(params);
+    } else if (strcmp(methodName, "roi") == 0) {
+        set_roi(params);
+    } else if (strcmp(methodName, "fit") == 0) {
+        if (image_fit_parse(params, &fit) != 0)
+            LOG_WARN("Unknown fit %s", params);
     } else {
         LOG_WARN("Invalid RPC.");
     }
 }
 
+static int
+open_camera(struct camera *cam)
+{
+    int32_t res = senscord_core_open_stream(core, cam->key, &cam->stream);
+    LOG_DBG("senscord_core_open_stream(%s): ret=%d, stream=%ju", cam->key,
+            res, (uintmax_t)cam->stream);
+    if (res != 0) {
+        print_senscord_error(senscord_get_last_error());
+        return -1;
+    }
+
+    res = senscord_stream_start(cam->stream);
+    LOG_DBG("senscord_stream_start(): ret=%d", res);
+    if (res != 0) {
+        print_senscord_error(senscord_get_last_error());
+        senscord_core_close_stream(core, cam->stream);
+        return -1;
+    }
+    if (get_and_update_image_property(cam) != 0) {
+        senscord_stream_stop(cam->stream);
+        senscord_core_close_stream(core, cam->stream);
+        return -1;
+    }
+    cam->full_width = cam->width;
+    cam->full_height = cam->height;
+
+    res = senscord_stream_register_frame_callback(
+        cam->stream, frame_received_cb, cam);
+    LOG_DBG("senscord_stream_register_frame_callback(): ret=%d", res);
+    cam->has_frame_callback = res == 0;
+    if (!cam->has_frame_callback)
+        LOG_WARN("%s: no frame callback, polling the stream instead",
+                 cam->key);
+
+    init_rate_control(cam);
+    cam->is_open = true;
+    return 0;
+}
+
+static int
+close_camera(struct camera *cam)
+{
+    if (cam->has_frame_callback)
+        senscord_stream_unregister_frame_callback(cam->stream);
+    restore_capture_rate(cam);
+    cam->is_open = false;
+
+    int32_t res = senscord_stream_stop(cam->stream);
+    LOG_DBG("senscord_stream_stop(): ret=%d", res);
+    if (res != 0) {
+        print_senscord_error(senscord_get_last_error());
+        return -1;
+    }
+
+    res = senscord_core_close_stream(core, cam->stream);
+    LOG_DBG("senscord_core_close_stream(): ret=%d", res);
+    if (res != 0) {
+        print_senscord_error(senscord_get_last_error());
+        return -1;
+    }
+    return 0;
+}
+
 int
 main(int argc, const char *argv[])
 {
@@ -253,7 +1010,7 @@ main(int argc, const char *argv[])
     result = EVP_setRpcCallback(h, rpc_callback, NULL);
     assert(result == EVP_OK);
 
-    while (stream_key == NULL) {
+    while (!configured) {
         result = EVP_processEvent(h, 10);
         if (result == EVP_SHOULDEXIT) {
             LOG_INFO("Exiting the main loop");
@@ -267,49 +1024,47 @@ main(int argc, const char *argv[])
         return -1;
     }
 
-    res = senscord_core_open_stream(core, stream_key, &stream);
-    LOG_DBG("senscord_core_open_stream(): ret=%d, stream=%ju", res,
-            (uintmax_t)stream);
-    if (res != 0) {
-        print_senscord_error(senscord_get_last_error());
-        return -1;
-    }
-
-    res = senscord_stream_start(stream);
-    LOG_DBG("senscord_stream_start(): ret=%d", res);
-    if (res != 0) {
-        print_senscord_error(senscord_get_last_error());
-        return -1;
+    // A stream that fails to open leaves a gap, so the stream ids stay
+    // those of the configuration.
+    uint32_t opened = 0;
+    for (uint32_t i = 0; i < num_cameras; ++i) {
+        if (open_camera(&cameras[i]) == 0)
+            opened++;
+        else
+            LOG_ERR("Cannot open stream %s", cameras[i].key);
     }
-    if (get_and_update_image_property() != 0)
+    if (opened == 0)
         return -1;
+    rate_window_start = now_ms();
 
     LOG_DBG("Starting...");
     for (;;) {
-        if (ready_receive)
-            send_frame();
-
-        for (int i = 0; i < 10; ++i) {
-            result = EVP_processEvent(h, 10);
-            if (result == EVP_SHOULDEXIT) {
-                LOG_DBG("%s: exiting the main loop", module_name);
-                goto END;
-            }
+        for (uint32_t i = 0; i < num_cameras; ++i) {
+            if (!cameras[i].is_open || !cameras[i].roi_changed)
+                continue;
+            // Of the old geometry
+            if (held.cam == &cameras[i])
+                release_frame(&held);
+            apply_roi(&cameras[i]);
+        }
+        pump_frames();
+        update_capture_rates();
+
+        result = EVP_processEvent(h, EVENT_POLL_MSEC);
+        if (result == EVP_SHOULDEXIT) {
+            LOG_DBG("%s: exiting the main loop", module_name);
+            goto END;
         }
     }
 END:
-    res = senscord_stream_stop(stream);
-    LOG_DBG("senscord_stream_stop(): ret=%d", res);
-    if (res != 0) {
-        print_senscord_error(senscord_get_last_error());
-        return -1;
-    }
+    if (prefetched != NULL)
+        frame_buffer_release(prefetched);
+    if (held.cam != NULL)
+        release_frame(&held);
 
-    res = senscord_core_close_stream(core, stream);
-    LOG_DBG("senscord_core_close_stream(): ret=%d", res);
-    if (res != 0) {
-        print_senscord_error(senscord_get_last_error());
-        return -1;
+    for (uint32_t i = 0; i < num_cameras; ++i) {
+        if (cameras[i].is_open && close_camera(&cameras[i]) != 0)
+            return -1;
     }
 
     res = senscord_core_exit(core);
@@ -319,6 +1074,12 @@ END:
         return -1;
     }
 END2:
-    free(stream_key);
+    for (uint32_t i = 0; i < num_cameras; ++i)
+        free(cameras[i].key);
+    free(staging);
+    for (int i = 0; i < FRAME_POOL_SIZE; ++i) {
+        if (frame_pool[i].refs == 0)
+            free(frame_pool[i].data);
+    }
     return 0;
 }
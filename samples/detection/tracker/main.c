@@ -0,0 +1,171 @@
+#include <assert.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "evp/sdk.h"
+#include "frame_meta.h"
+#include "logger.h"
+#include "parson.h"
+#include "sort.h"
+#include "track_utils.hpp"
+
+#define INPUT_TOPIC  "detections"
+#define OUTPUT_TOPIC "tracks"
+
+static const char *module_name = "TRACKER";
+static struct EVP_client *h = NULL;
+
+static sort_params_t params;
+static sort_tracker_t trackers[MAX_STREAMS];
+static sort_box_t boxes[SORT_MAX_BOXES];
+
+static void
+send_message_cb(EVP_MESSAGE_SENT_CALLBACK_REASON reason, void *userData)
+{
+    // The payload belongs to track_utils until released.
+    track_release(userData);
+}
+
+static void
+message_cb(const char *topic, const void *msgPayload, size_t msgPayloadLen,
+           void *userData)
+{
+    LOG_DBG("%s: Received Message (topic=%s, size=%zu)", module_name, topic,
+            msgPayloadLen);
+    if (strcmp(topic, INPUT_TOPIC) != 0 || msgPayloadLen == 0)
+        return;
+
+    track_frame_t frame;
+    uint32_t count =
+        track_read_detections(msgPayload, &frame, boxes, SORT_MAX_BOXES);
+    sort_tracker_t *t = &trackers[frame.stream_id % MAX_STREAMS];
+    // Frames the detector skipped get the boxes the tracks predict.
+    if (frame.inferred)
+        sort_update(t, &params, frame.timestamp, boxes, count);
+    else
+        count = sort_predict(t, &params, frame.timestamp, boxes,
+                             SORT_MAX_BOXES);
+    LOG_DBG("Frame %u: %u boxes%s", frame.frame_id, count,
+            frame.inferred ? "" : " predicted");
+
+    size_t size;
+    const void *payload = track_build(&frame, boxes, count, &size);
+    if (payload == NULL) {
+        LOG_ERR("All results are still being sent, dropping frame %u",
+                frame.frame_id);
+        return;
+    }
+    EVP_RESULT result = EVP_sendMessage(h, OUTPUT_TOPIC, payload, size,
+                                        send_message_cb, (void *)payload);
+    if (EVP_OK != result) {
+        LOG_ERR("%s %s %d: calling EVP_sendMessage", module_name,
+                OUTPUT_TOPIC, result);
+        // No callback will come for a message that was not queued.
+        send_message_cb(EVP_MESSAGE_SENT_CALLBACK_REASON_ERROR,
+                        (void *)payload);
+    }
+}
+
+// Read the count `key`, if present, into `*out`. Returns false if it is not
+// a whole number that fits a uint32_t.
+static bool
+get_count(const JSON_Object *o, const char *key, uint32_t *out)
+{
+    if (!json_object_has_value_of_type(o, key, JSONNumber))
+        return true;
+    double v = json_object_get_number(o, key);
+    if (!(v >= 0 && v <= UINT32_MAX) || v != (uint32_t)v)
+        return false;
+    *out = (uint32_t)v;
+    return true;
+}
+
+// JSON object with iou_threshold, max_age_ms and min_hits, all optional;
+// missing keys take their defaults.
+static void
+apply_params(const char *text)
+{
+    JSON_Value *value = json_parse_string(text);
+    const JSON_Object *o = json_value_get_object(value);
+    if (o == NULL) {
+        LOG_ERR("Invalid tracker parameters, keeping the previous ones");
+        json_value_free(value);
+        return;
+    }
+    sort_params_t p;
+    sort_default_params(&p);
+    if (json_object_has_value_of_type(o, "iou_threshold", JSONNumber))
+        p.iou_threshold = json_object_get_number(o, "iou_threshold");
+    bool counts_valid = get_count(o, "max_age_ms", &p.max_age_ms) &&
+                        get_count(o, "min_hits", &p.min_hits);
+    json_value_free(value);
+    if (!(p.iou_threshold > 0 && p.iou_threshold <= 1)) {
+        LOG_ERR("iou_threshold must be in (0, 1]");
+        return;
+    }
+    if (!counts_valid) {
+        LOG_ERR("max_age_ms and min_hits must be whole numbers >= 0");
+        return;
+    }
+    params = p;
+    LOG_INFO("Tracking: IoU %.2f, max age %u ms, %u hits",
+             params.iou_threshold, params.max_age_ms, params.min_hits);
+}
+
+static void
+config_cb(const char *topic, const void *config, size_t configlen,
+          void *userData)
+{
+    LOG_DBG("%s: Received configuration (topic=%s, size=%zu)", module_name,
+            topic, configlen);
+    char *text = strndup(config, configlen);
+    assert(text != NULL);
+    apply_params(text);
+    free(text);
+}
+
+void
+rpc_callback(EVP_RPC_ID id, const char *methodName, const char *params,
+             void *userData)
+{
+    LOG_DBG("RPC: methodName=%s params=%s", methodName, params);
+    if (strcmp(methodName, "config") == 0) {
+        apply_params(params);
+    } else if (strcmp(methodName, "reset") == 0) {
+        for (int i = 0; i < MAX_STREAMS; ++i)
+            sort_reset(&trackers[i]);
+        LOG_INFO("Tracks cleared");
+    } else {
+        LOG_WARN("Invalid RPC.");
+    }
+}
+
+int
+main(int argc, const char *argv[])
+{
+    LOG_DBG("%s: Started!", module_name);
+    sort_default_params(&params);
+    for (int i = 0; i < MAX_STREAMS; ++i)
+        sort_reset(&trackers[i]);
+
+    h = EVP_initialize();
+    EVP_RESULT result = EVP_setMessageCallback(h, message_cb, NULL);
+    assert(result == EVP_OK);
+    result = EVP_setRpcCallback(h, rpc_callback, NULL);
+    assert(result == EVP_OK);
+    result = EVP_setConfigurationCallback(h, config_cb, NULL);
+    assert(result == EVP_OK);
+
+    for (;;) {
+        result = EVP_processEvent(h, 1000);
+        if (result == EVP_SHOULDEXIT) {
+            LOG_DBG("%s: exiting the main loop", module_name);
+            break;
+        }
+    }
+    return 0;
+}
@@ -0,0 +1,266 @@
+#include "sort.h"
+
+#include <string.h>
+
+// Assumed time between frames without timestamps
+#define DEFAULT_FRAME_NS 33333333
+// Variance of a measured coordinate, in normalized units
+#define MEASUREMENT_VAR (0.01f * 0.01f)
+// Variance of the velocity of a new track, per second
+#define VELOCITY_VAR 0.25f
+// Spectral density of the acceleration noise
+#define ACCEL_VAR 0.5f
+// Smallest predicted width or height
+#define MIN_SIZE 1e-3f
+
+enum { KF_CX, KF_CY, KF_W, KF_H };
+
+void
+sort_default_params(sort_params_t *params)
+{
+    params->iou_threshold = 0.3f;
+    params->max_age_ms = 1000;
+    params->min_hits = 3;
+}
+
+void
+sort_reset(sort_tracker_t *t)
+{
+    memset(t, 0, sizeof(*t));
+    t->next_id = 1;
+}
+
+static void
+kf_init(sort_kf_t *kf, float z)
+{
+    kf->x = z;
+    kf->v = 0;
+    kf->p[0][0] = MEASUREMENT_VAR;
+    kf->p[0][1] = kf->p[1][0] = 0;
+    kf->p[1][1] = VELOCITY_VAR;
+}
+
+// Constant velocity over `dt` seconds, with white noise acceleration.
+static void
+kf_predict(sort_kf_t *kf, float dt)
+{
+    float (*p)[2] = kf->p;
+    kf->x += kf->v * dt;
+    float p00 = p[0][0] + dt * (p[0][1] + p[1][0]) + dt * dt * p[1][1];
+    float p01 = p[0][1] + dt * p[1][1];
+    float p10 = p[1][0] + dt * p[1][1];
+    float dt2 = dt * dt;
+    p[0][0] = p00 + ACCEL_VAR * dt2 * dt2 / 4;
+    p[0][1] = p01 + ACCEL_VAR * dt2 * dt / 2;
+    p[1][0] = p10 + ACCEL_VAR * dt2 * dt / 2;
+    p[1][1] += ACCEL_VAR * dt2;
+}
+
+static void
+kf_update(sort_kf_t *kf, float z)
+{
+    float (*p)[2] = kf->p;
+    float s = p[0][0] + MEASUREMENT_VAR;
+    float k0 = p[0][0] / s, k1 = p[1][0] / s;
+    float y = z - kf->x;
+    kf->x += k0 * y;
+    kf->v += k1 * y;
+    float p00 = p[0][0], p01 = p[0][1];
+    p[0][0] -= k0 * p00;
+    p[0][1] -= k0 * p01;
+    p[1][0] -= k1 * p00;
+    p[1][1] -= k1 * p01;
+}
+
+static void
+track_box(const sort_track_t *track, sort_box_t *box)
+{
+    float w = track->kf[KF_W].x > MIN_SIZE ? track->kf[KF_W].x : MIN_SIZE;
+    float h = track->kf[KF_H].x > MIN_SIZE ? track->kf[KF_H].x : MIN_SIZE;
+    box->x_min = track->kf[KF_CX].x - w / 2;
+    box->x_max = track->kf[KF_CX].x + w / 2;
+    box->y_min = track->kf[KF_CY].x - h / 2;
+    box->y_max = track->kf[KF_CY].x + h / 2;
+    box->score = track->score;
+    box->category = track->category;
+    box->track_id = track->id;
+    box->label = track->label;
+    box->label_score = track->label_score;
+}
+
+static void
+box_measurement(const sort_box_t *box, float z[4])
+{
+    z[KF_CX] = (box->x_min + box->x_max) / 2;
+    z[KF_CY] = (box->y_min + box->y_max) / 2;
+    z[KF_W] = box->x_max - box->x_min;
+    z[KF_H] = box->y_max - box->y_min;
+}
+
+static float
+iou(const sort_box_t *a, const sort_box_t *b)
+{
+    float w = (a->x_max < b->x_max ? a->x_max : b->x_max) -
+              (a->x_min > b->x_min ? a->x_min : b->x_min);
+    float h = (a->y_max < b->y_max ? a->y_max : b->y_max) -
+              (a->y_min > b->y_min ? a->y_min : b->y_min);
+    if (w <= 0 || h <= 0)
+        return 0;
+    float inter = w * h;
+    float area_a = (a->x_max - a->x_min) * (a->y_max - a->y_min);
+    float area_b = (b->x_max - b->x_min) * (b->y_max - b->y_min);
+    return inter / (area_a + area_b - inter);
+}
+
+// Bring the tracks to `timestamp`, dropping those not seen for too long.
+static void
+advance(sort_tracker_t *t, const sort_params_t *params, uint64_t timestamp)
+{
+    uint64_t ns;
+    if (timestamp == 0) {
+        // No timestamps: one frame at a time
+        ns = DEFAULT_FRAME_NS;
+        timestamp = t->time + ns;
+    } else if (t->time == 0 || timestamp < t->time) {
+        // First frame, or one that arrived late
+        ns = 0;
+        if (timestamp < t->time)
+            timestamp = t->time;
+    } else {
+        ns = timestamp - t->time;
+    }
+    float dt = ns / 1e9f;
+    t->time = timestamp;
+
+    uint64_t max_age = (uint64_t)params->max_age_ms * 1000000;
+    for (uint32_t i = 0; i < SORT_MAX_TRACKS; ++i) {
+        sort_track_t *track = &t->tracks[i];
+        if (!track->active)
+            continue;
+        if (timestamp - track->last_seen > max_age) {
+            track->active = false;
+            continue;
+        }
+        for (int k = 0; k < 4; ++k)
+            kf_predict(&track->kf[k], dt);
+    }
+}
+
+static void
+start_track(sort_tracker_t *t, const sort_params_t *params, sort_box_t *box)
+{
+    for (uint32_t i = 0; i < SORT_MAX_TRACKS; ++i) {
+        sort_track_t *track = &t->tracks[i];
+        if (track->active)
+            continue;
+        float z[4];
+        box_measurement(box, z);
+        for (int k = 0; k < 4; ++k)
+            kf_init(&track->kf[k], z[k]);
+        track->active = true;
+        track->id = t->next_id++;
+        if (t->next_id == 0)
+            t->next_id = 1;
+        track->hits = 1;
+        track->last_seen = t->time;
+        track->score = box->score;
+        track->category = box->category;
+        track->label = box->label;
+        track->label_score = box->label_score;
+        box->track_id = params->min_hits <= 1 ? track->id : 0;
+        return;
+    }
+    box->track_id = 0;
+}
+
+void
+sort_update(sort_tracker_t *t, const sort_params_t *params,
+            uint64_t timestamp, sort_box_t *boxes, uint32_t count)
+{
+    static float ious[SORT_MAX_TRACKS][SORT_MAX_BOXES];
+    bool track_matched[SORT_MAX_TRACKS] = {false};
+    bool box_matched[SORT_MAX_BOXES] = {false};
+
+    if (count > SORT_MAX_BOXES)
+        count = SORT_MAX_BOXES;
+    advance(t, params, timestamp);
+
+    for (uint32_t i = 0; i < SORT_MAX_TRACKS; ++i) {
+        sort_box_t predicted;
+        if (t->tracks[i].active)
+            track_box(&t->tracks[i], &predicted);
+        for (uint32_t j = 0; j < count; ++j)
+            ious[i][j] = t->tracks[i].active &&
+                                 t->tracks[i].category == boxes[j].category
+                             ? iou(&predicted, &boxes[j])
+                             : 0;
+    }
+
+    // Greedy matching, best overlap first
+    for (;;) {
+        float best = params->iou_threshold;
+        int32_t bi = -1, bj = -1;
+        for (uint32_t i = 0; i < SORT_MAX_TRACKS; ++i) {
+            if (track_matched[i])
+                continue;
+            for (uint32_t j = 0; j < count; ++j) {
+                if (!box_matched[j] && ious[i][j] > 0 && ious[i][j] >= best) {
+                    best = ious[i][j];
+                    bi = i;
+                    bj = j;
+                }
+            }
+        }
+        if (bi < 0)
+            break;
+        track_matched[bi] = box_matched[bj] = true;
+
+        sort_track_t *track = &t->tracks[bi];
+        float z[4];
+        box_measurement(&boxes[bj], z);
+        for (int k = 0; k < 4; ++k)
+            kf_update(&track->kf[k], z[k]);
+        track->hits++;
+        track->last_seen = t->time;
+        track->score = boxes[bj].score;
+        if (boxes[bj].label_score > 0) {
+            track->label = boxes[bj].label;
+            track->label_score = boxes[bj].label_score;
+        } else {
+            boxes[bj].label = track->label;
+            boxes[bj].label_score = track->label_score;
+        }
+        boxes[bj].track_id = track->hits >= params->min_hits ? track->id : 0;
+    }
+
+    // Tracks not confirmed yet must be detected in a row.
+    for (uint32_t i = 0; i < SORT_MAX_TRACKS; ++i) {
+        sort_track_t *track = &t->tracks[i];
+        if (track->active && !track_matched[i] &&
+            track->hits < params->min_hits)
+            track->active = false;
+    }
+    for (uint32_t j = 0; j < count; ++j) {
+        if (!box_matched[j])
+            start_track(t, params, &boxes[j]);
+    }
+}
+
+uint32_t
+sort_predict(sort_tracker_t *t, const sort_params_t *params,
+             uint64_t timestamp, sort_box_t *out, uint32_t max)
+{
+    advance(t, params, timestamp);
+    uint32_t n = 0;
+    for (uint32_t i = 0; i < SORT_MAX_TRACKS && n < max; ++i) {
+        const sort_track_t *track = &t->tracks[i];
+        if (!track->active || track->hits < params->min_hits)
+            continue;
+        track_box(track, &out[n]);
+        if (out[n].x_max <= 0 || out[n].y_max <= 0 || out[n].x_min >= 1 ||
+            out[n].y_min >= 1)
+            continue;
+        n++;
+    }
+    return n;
+}
@@ -0,0 +1,91 @@
+#ifndef SORT_H
+#define SORT_H
+
+#include <stdbool.h>
+#include <stdint.h>
+
+/*
+ * SORT-style multi-object tracker: boxes are predicted with a constant
+ * velocity Kalman filter and matched to the detections by IoU. All state
+ * lives in fixed arrays, so tracking a frame allocates nothing.
+ */
+
+#define SORT_MAX_TRACKS 32
+// Boxes per frame, as many as the PPL reports at most
+#define SORT_MAX_BOXES 100
+
+// Box normalized to the frame
+typedef struct {
+    float x_min;
+    float y_min;
+    float x_max;
+    float y_max;
+    float score;
+    uint32_t category;
+    // Set by the tracker; 0 while the track is not confirmed
+    uint32_t track_id;
+    // Second stage class and score of a cascade, score 0 for none. A track
+    // keeps the last one it was detected with.
+    uint32_t label;
+    float label_score;
+} sort_box_t;
+
+typedef struct {
+    // Lowest IoU between a predicted box and a detection to match them
+    float iou_threshold;
+    // A track is dropped once it has not been detected for this long
+    uint32_t max_age_ms;
+    // Detections in a row before a track gets its id
+    uint32_t min_hits;
+} sort_params_t;
+
+// Position and velocity of one box coordinate, filtered independently
+typedef struct {
+    float x;
+    float v;
+    float p[2][2];
+} sort_kf_t;
+
+typedef struct {
+    bool active;
+    uint32_t id;
+    uint32_t hits;
+    uint64_t last_seen;
+    float score;
+    uint32_t category;
+    uint32_t label;
+    float label_score;
+    // Center x, center y, width and height
+    sort_kf_t kf[4];
+} sort_track_t;
+
+// Tracks of one camera
+typedef struct {
+    sort_track_t tracks[SORT_MAX_TRACKS];
+    // Timestamp the tracks were last predicted to, in nanoseconds
+    uint64_t time;
+    uint32_t next_id;
+} sort_tracker_t;
+
+void sort_default_params(sort_params_t *params);
+
+void sort_reset(sort_tracker_t *t);
+
+/**
+ * Match the `count` detections of a frame taken at `timestamp` (ns) with
+ * the tracks, and set their track_id: the id of a confirmed track, 0
+ * otherwise. Unmatched detections start new tracks.
+ */
+void sort_update(sort_tracker_t *t, const sort_params_t *params,
+                 uint64_t timestamp, sort_box_t *boxes, uint32_t count);
+
+/**
+ * Boxes of the confirmed tracks predicted to `timestamp`, for frames the
+ * detector skipped.
+ *
+ * @return the number of boxes written to `out`, at most `max`.
+ */
+uint32_t sort_predict(sort_tracker_t *t, const sort_params_t *params,
+                      uint64_t timestamp, sort_box_t *out, uint32_t max);
+
+#endif
@@ -0,0 +1,111 @@
+#include "track_utils.hpp"
+#include "logger.h"
+#include "postprocessed_detection_generated.h"
+
+// Builders are reused, as in ppl_detection_ssd.
+struct result_slot {
+    flatbuffers::FlatBufferBuilder builder;
+    bool in_use = false;
+};
+
+static result_slot result_slots[TRACK_RESULT_SLOTS];
+
+extern "C" uint32_t
+track_read_detections(const void *buf, track_frame_t *frame,
+                      sort_box_t *boxes, uint32_t max)
+{
+    auto detection = postprocessed::GetDetection(buf);
+    frame->frame_id = detection->frame_id();
+    frame->timestamp = detection->timestamp();
+    frame->stream_id = detection->stream_id();
+    frame->inferred = detection->inferred();
+
+    auto annotations = detection->annotations();
+    uint32_t size = annotations ? annotations->size() : 0;
+    auto classes = detection->cascade_classes();
+    auto scores = detection->cascade_scores();
+    uint32_t labels = classes && scores ? classes->size() : 0;
+    if (scores && scores->size() < labels)
+        labels = scores->size();
+    uint32_t n = 0;
+    for (uint32_t i = 0; i < size && n < max; ++i) {
+        auto ann = annotations->Get(i);
+        boxes[n++] = {.x_min = ann->bbox().x_min(),
+                      .y_min = ann->bbox().y_min(),
+                      .x_max = ann->bbox().x_max(),
+                      .y_max = ann->bbox().y_max(),
+                      .score = ann->prob(),
+                      .category = (uint32_t)ann->category(),
+                      .track_id = 0,
+                      .label = i < labels ? classes->Get(i) : 0,
+                      .label_score = i < labels ? scores->Get(i) : 0};
+    }
+    return n;
+}
+
+extern "C" const void *
+track_build(const track_frame_t *frame, const sort_box_t *boxes,
+            uint32_t count, size_t *size)
+{
+    result_slot *slot = nullptr;
+    for (auto &s : result_slots) {
+        if (!s.in_use) {
+            slot = &s;
+            break;
+        }
+    }
+    if (slot == nullptr)
+        return nullptr;
+    slot->in_use = true;
+    auto &builder = slot->builder;
+    builder.Clear();
+
+    postprocessed::DetectionAnn *anns;
+    auto annotations =
+        builder.CreateUninitializedVectorOfStructs(count, &anns);
+    for (uint32_t i = 0; i < count; ++i) {
+        const sort_box_t *b = &boxes[i];
+        auto bbox =
+            postprocessed::Bbox(b->x_min, b->x_max, b->y_min, b->y_max);
+        anns[i] = postprocessed::DetectionAnn(bbox, b->score, b->category);
+    }
+    uint32_t *ids;
+    auto track_ids = builder.CreateUninitializedVector(count, &ids);
+    for (uint32_t i = 0; i < count; ++i)
+        ids[i] = boxes[i].track_id;
+
+    bool labelled = false;
+    for (uint32_t i = 0; i < count && !labelled; ++i)
+        labelled = boxes[i].label_score > 0;
+    flatbuffers::Offset<flatbuffers::Vector<uint32_t>> classes_offset;
+    flatbuffers::Offset<flatbuffers::Vector<float>> scores_offset;
+    if (labelled) {
+        uint32_t *classes;
+        classes_offset = builder.CreateUninitializedVector(count, &classes);
+        for (uint32_t i = 0; i < count; ++i)
+            classes[i] = boxes[i].label;
+        float *scores;
+        scores_offset = builder.CreateUninitializedVector(count, &scores);
+        for (uint32_t i = 0; i < count; ++i)
+            scores[i] = boxes[i].label_score;
+    }
+
+    builder.Finish(postprocessed::CreateDetection(
+        builder, annotations, frame->frame_id, frame->timestamp,
+        frame->stream_id, track_ids, frame->inferred, classes_offset,
+        scores_offset));
+    *size = builder.GetSize();
+    return builder.GetBufferPointer();
+}
+
+extern "C" void
+track_release(const void *buf)
+{
+    for (auto &slot : result_slots) {
+        if (slot.in_use && slot.builder.GetBufferPointer() == buf) {
+            slot.in_use = false;
+            return;
+        }
+    }
+    LOG_WARN("track_release: unknown result %p", buf);
+}
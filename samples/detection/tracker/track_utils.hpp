@@ -0,0 +1,49 @@
+#ifndef TRACK_UTILS_HPP
+#define TRACK_UTILS_HPP
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include "sort.h"
+
+// Results that can be out at once, waiting for track_release
+#define TRACK_RESULT_SLOTS 4
+
+// Everything of a Detection buffer but its boxes
+typedef struct {
+    uint32_t frame_id;
+    uint64_t timestamp;
+    uint32_t stream_id;
+    bool inferred;
+} track_frame_t;
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**
+ * Read up to `max` boxes of a Detection buffer into `boxes`, and the rest
+ * into `frame`.
+ *
+ * @return the number of boxes written.
+ */
+uint32_t track_read_detections(const void *buf, track_frame_t *frame,
+                               sort_box_t *boxes, uint32_t max);
+
+/**
+ * Build a Detection buffer from `count` tracked boxes.
+ *
+ * @return the buffer, owned by the module until track_release, or NULL if
+ * all TRACK_RESULT_SLOTS are in use.
+ */
+const void *track_build(const track_frame_t *frame, const sort_box_t *boxes,
+                        uint32_t count, size_t *size);
+
+void track_release(const void *buf);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
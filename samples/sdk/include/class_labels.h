@@ -0,0 +1,69 @@
+#ifndef CLASS_LABELS_H
+#define CLASS_LABELS_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "parson.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/*
+ * Class names for overlay labels, indexed by the class id the model
+ * reports. They are loaded once from the configuration, so formatting a
+ * label per box does not allocate.
+ */
+
+#define CLASS_LABELS_MAX 256
+// Enough for a name, its score and the terminator; longer names are cut.
+#define CLASS_LABELS_TEXT_SIZE 32
+
+/**
+ * Replace the table with the strings of `names`: names[i] is the name of
+ * class i. Entries that are not strings, and classes past the array, have
+ * no name.
+ *
+ * @return 0 on success, -1 if the table could not be allocated, in which
+ *         case the previous names are kept.
+ */
+int class_labels_load(const JSON_Array *names);
+
+/**
+ * @return the name of class `cls`, or NULL if it has none.
+ */
+const char *class_labels_name(uint32_t cls);
+
+/**
+ * Write "<name> <score>%" into `buf`, e.g. "person 87%", with the class id
+ * in place of a missing name.
+ *
+ * @return the length of the text.
+ */
+size_t class_labels_format(char *buf, size_t size, uint32_t cls,
+                           float score);
+
+/**
+ * Append the decimal digits of `v` to the `len` characters of `buf`, as
+ * far as they fit before its last byte. The text is not terminated.
+ *
+ * @return the new length.
+ */
+size_t class_labels_append_uint(char *buf, size_t len, size_t size,
+                                uint32_t v);
+
+/**
+ * Append `score` as a rounded percentage, e.g. "87%", like
+ * class_labels_append_uint().
+ */
+size_t class_labels_append_score(char *buf, size_t len, size_t size,
+                                 float score);
+
+void class_labels_free(void);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
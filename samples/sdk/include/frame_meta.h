@@ -0,0 +1,64 @@
+#ifndef FRAME_META_H
+#define FRAME_META_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+
+// "FRM2", little endian
+#define FRAME_META_MAGIC 0x324d5246
+// Cameras one source captures from, so the range of stream_id
+#define MAX_STREAMS 4
+
+// Trailer the source appends to every RGB24 frame it publishes. It follows
+// the pixels, so consumers that ignore it still find the image at offset 0.
+typedef struct {
+    uint32_t magic;
+    // Increments per published frame, skipping 0, which means unknown.
+    uint32_t frame_id;
+    // Sensor timestamp of the frame, in nanoseconds
+    uint64_t timestamp;
+    uint32_t width;
+    uint32_t height;
+    // Camera the frame comes from, in the order the source was configured
+    // with, below MAX_STREAMS
+    uint32_t stream_id;
+    uint32_t reserved;
+} frame_meta_t;
+
+// Size of a published frame: the pixels plus the trailer.
+static inline size_t
+frame_meta_frame_size(uint32_t width, uint32_t height)
+{
+    return (size_t)width * height * 3 + sizeof(frame_meta_t);
+}
+
+// Write `meta` after the pixels of `frame`.
+static inline void
+frame_meta_write(void *frame, const frame_meta_t *meta)
+{
+    size_t pixels = (size_t)meta->width * meta->height * 3;
+    memcpy((uint8_t *)frame + pixels, meta, sizeof(*meta));
+}
+
+/**
+ * Read the trailer of a frame payload.
+ *
+ * @return false, with `meta` zeroed, if the payload has no valid trailer.
+ */
+static inline bool
+frame_meta_read(const void *payload, size_t size, frame_meta_t *meta)
+{
+    if (size >= sizeof(*meta)) {
+        memcpy(meta, (const uint8_t *)payload + size - sizeof(*meta),
+               sizeof(*meta));
+        if (meta->magic == FRAME_META_MAGIC &&
+            frame_meta_frame_size(meta->width, meta->height) == size)
+            return true;
+    }
+    memset(meta, 0, sizeof(*meta));
+    return false;
+}
+
+#endif
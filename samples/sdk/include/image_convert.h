@@ -0,0 +1,73 @@
+#ifndef IMAGE_CONVERT_H
+#define IMAGE_CONVERT_H
+
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+typedef enum {
+    IMAGE_FORMAT_RGB24 = 0,
+    IMAGE_FORMAT_NV16,
+} image_format_t;
+
+// How the source is fitted to the output size
+typedef enum {
+    // Nearest neighbour over the whole source, ignoring its aspect ratio
+    IMAGE_FIT_STRETCH = 0,
+    // Bilinear, scaled to fit inside the output, with black bars
+    IMAGE_FIT_LETTERBOX,
+    // Bilinear, scaled to cover the output, cropping the middle
+    IMAGE_FIT_CROP,
+} image_fit_t;
+
+// Source image as delivered by the sensor. For NV16, `data` points to the Y
+// plane and `uv` to the interleaved CbCr plane; both planes share `stride`.
+typedef struct {
+    const uint8_t *data;
+    const uint8_t *uv;
+    uint32_t width;
+    uint32_t height;
+    uint32_t stride;
+    image_format_t format;
+} image_src_t;
+
+/**
+ * Fill `src` for a packed sensor buffer of the given pixel format
+ * ("image_nv16" or "image_rgb24"). A zero `stride` means tightly packed.
+ *
+ * @return 0 on success, -1 if the pixel format is not supported.
+ */
+int image_src_init(image_src_t *src, const uint8_t *buf, uint32_t width,
+                   uint32_t height, uint32_t stride, const char *pixel_format);
+
+/**
+ * Convert and nearest-neighbour resize `src` into a packed RGB24 buffer of
+ * `dst_width` x `dst_height` in a single pass. Only the source pixels that
+ * land in the output are read.
+ */
+void image_convert_rgb24(const image_src_t *src, uint8_t *dst,
+                         uint32_t dst_width, uint32_t dst_height);
+
+/**
+ * Same as image_convert_rgb24(), with the source fitted to the output as
+ * `fit` says. The bilinear fits use 8-bit fixed-point weights and convert
+ * each source row they read once.
+ */
+void image_convert_rgb24_fit(const image_src_t *src, uint8_t *dst,
+                             uint32_t dst_width, uint32_t dst_height,
+                             image_fit_t fit);
+
+/**
+ * Parse "stretch", "letterbox" or "crop".
+ *
+ * @return 0 on success, -1 if `name` is none of them.
+ */
+int image_fit_parse(const char *name, image_fit_t *fit);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -0,0 +1,52 @@
+#ifndef MODEL_CACHE_H
+#define MODEL_CACHE_H
+
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/*
+ * Content-addressed model cache in the module workspace.
+ *
+ * Models are stored as <sha256>.tflite next to a manifest with one line per
+ * URL: "<sha256> <size> <last used> <url>". A restart finds the model by URL
+ * and skips the download; the least recently used entries are evicted once
+ * there are more than `max_entries`.
+ */
+
+/**
+ * Load the manifest from `dir`. Entries whose file is missing are dropped.
+ */
+int model_cache_init(const char *dir, uint32_t max_entries);
+
+/**
+ * Look up the model downloaded from `url`. The file size and checksum are
+ * verified; an entry that fails is removed from the cache.
+ *
+ * @return malloc'ed path of the cached model, or NULL on a miss.
+ */
+char *model_cache_lookup(const char *url);
+
+/**
+ * Path to download a model into before model_cache_insert(). Owned by the
+ * cache.
+ */
+const char *model_cache_download_path(void);
+
+/**
+ * Move the file downloaded from `url` at model_cache_download_path() into
+ * the cache.
+ *
+ * @return malloc'ed path of the cached model, or NULL on error.
+ */
+char *model_cache_insert(const char *url);
+
+void model_cache_deinit(void);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
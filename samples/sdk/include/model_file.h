@@ -0,0 +1,30 @@
+#ifndef MODEL_FILE_H
+#define MODEL_FILE_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**
+ * Read a whole model file into a buffer sized from fstat, with no fixed
+ * upper bound. The caller frees the buffer once the model has been handed
+ * to wasi-nn.
+ *
+ * @return the buffer, or NULL if the file cannot be opened or read.
+ */
+uint8_t *model_file_read(const char *path, size_t *size);
+
+/**
+ * Current size of the module's linear memory in bytes. Memory never shrinks,
+ * so after loading this is the peak reached while loading.
+ */
+size_t model_file_memory_size(void);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -15,21 +15,218 @@ static_assert(FLATBUFFERS_VERSION_MAJOR == 23 &&
 
 namespace output_tensor {
 
+struct Tensor;
+struct TensorBuilder;
+
 struct OutputTensor;
 struct OutputTensorBuilder;
 
+enum TensorType : int8_t {
+  TensorType_Float32 = 0,
+  TensorType_UInt8 = 1,
+  TensorType_Int8 = 2,
+  TensorType_MIN = TensorType_Float32,
+  TensorType_MAX = TensorType_Int8
+};
+
+inline const TensorType (&EnumValuesTensorType())[3] {
+  static const TensorType values[] = {
+    TensorType_Float32,
+    TensorType_UInt8,
+    TensorType_Int8
+  };
+  return values;
+}
+
+inline const char * const *EnumNamesTensorType() {
+  static const char * const names[4] = {
+    "Float32",
+    "UInt8",
+    "Int8",
+    nullptr
+  };
+  return names;
+}
+
+inline const char *EnumNameTensorType(TensorType e) {
+  if (::flatbuffers::IsOutRange(e, TensorType_Float32, TensorType_Int8)) return "";
+  const size_t index = static_cast<size_t>(e);
+  return EnumNamesTensorType()[index];
+}
+
+struct Tensor FLATBUFFERS_FINAL_CLASS : private ::flatbuffers::Table {
+  typedef TensorBuilder Builder;
+  enum FlatBuffersVTableOffset FLATBUFFERS_VTABLE_UNDERLYING_TYPE {
+    VT_SHAPE = 4,
+    VT_TYPE = 6,
+    VT_SCALE = 8,
+    VT_ZERO_POINT = 10,
+    VT_DATA_F32 = 12,
+    VT_DATA_U8 = 14,
+    VT_DATA_I8 = 16
+  };
+  const ::flatbuffers::Vector<uint32_t> *shape() const {
+    return GetPointer<const ::flatbuffers::Vector<uint32_t> *>(VT_SHAPE);
+  }
+  output_tensor::TensorType type() const {
+    return static_cast<output_tensor::TensorType>(GetField<int8_t>(VT_TYPE, 0));
+  }
+  float scale() const {
+    return GetField<float>(VT_SCALE, 0.0f);
+  }
+  int32_t zero_point() const {
+    return GetField<int32_t>(VT_ZERO_POINT, 0);
+  }
+  const ::flatbuffers::Vector<float> *data_f32() const {
+    return GetPointer<const ::flatbuffers::Vector<float> *>(VT_DATA_F32);
+  }
+  const ::flatbuffers::Vector<uint8_t> *data_u8() const {
+    return GetPointer<const ::flatbuffers::Vector<uint8_t> *>(VT_DATA_U8);
+  }
+  const ::flatbuffers::Vector<int8_t> *data_i8() const {
+    return GetPointer<const ::flatbuffers::Vector<int8_t> *>(VT_DATA_I8);
+  }
+  bool Verify(::flatbuffers::Verifier &verifier) const {
+    return VerifyTableStart(verifier) &&
+           VerifyOffset(verifier, VT_SHAPE) &&
+           verifier.VerifyVector(shape()) &&
+           VerifyField<int8_t>(verifier, VT_TYPE, 1) &&
+           VerifyField<float>(verifier, VT_SCALE, 4) &&
+           VerifyField<int32_t>(verifier, VT_ZERO_POINT, 4) &&
+           VerifyOffset(verifier, VT_DATA_F32) &&
+           verifier.VerifyVector(data_f32()) &&
+           VerifyOffset(verifier, VT_DATA_U8) &&
+           verifier.VerifyVector(data_u8()) &&
+           VerifyOffset(verifier, VT_DATA_I8) &&
+           verifier.VerifyVector(data_i8()) &&
+           verifier.EndTable();
+  }
+};
+
+struct TensorBuilder {
+  typedef Tensor Table;
+  ::flatbuffers::FlatBufferBuilder &fbb_;
+  ::flatbuffers::uoffset_t start_;
+  void add_shape(::flatbuffers::Offset<::flatbuffers::Vector<uint32_t>> shape) {
+    fbb_.AddOffset(Tensor::VT_SHAPE, shape);
+  }
+  void add_type(output_tensor::TensorType type) {
+    fbb_.AddElement<int8_t>(Tensor::VT_TYPE, static_cast<int8_t>(type), 0);
+  }
+  void add_scale(float scale) {
+    fbb_.AddElement<float>(Tensor::VT_SCALE, scale, 0.0f);
+  }
+  void add_zero_point(int32_t zero_point) {
+    fbb_.AddElement<int32_t>(Tensor::VT_ZERO_POINT, zero_point, 0);
+  }
+  void add_data_f32(::flatbuffers::Offset<::flatbuffers::Vector<float>> data_f32) {
+    fbb_.AddOffset(Tensor::VT_DATA_F32, data_f32);
+  }
+  void add_data_u8(::flatbuffers::Offset<::flatbuffers::Vector<uint8_t>> data_u8) {
+    fbb_.AddOffset(Tensor::VT_DATA_U8, data_u8);
+  }
+  void add_data_i8(::flatbuffers::Offset<::flatbuffers::Vector<int8_t>> data_i8) {
+    fbb_.AddOffset(Tensor::VT_DATA_I8, data_i8);
+  }
+  explicit TensorBuilder(::flatbuffers::FlatBufferBuilder &_fbb)
+        : fbb_(_fbb) {
+    start_ = fbb_.StartTable();
+  }
+  ::flatbuffers::Offset<Tensor> Finish() {
+    const auto end = fbb_.EndTable(start_);
+    auto o = ::flatbuffers::Offset<Tensor>(end);
+    return o;
+  }
+};
+
+inline ::flatbuffers::Offset<Tensor> CreateTensor(
+    ::flatbuffers::FlatBufferBuilder &_fbb,
+    ::flatbuffers::Offset<::flatbuffers::Vector<uint32_t>> shape = 0,
+    output_tensor::TensorType type = output_tensor::TensorType_Float32,
+    float scale = 0.0f,
+    int32_t zero_point = 0,
+    ::flatbuffers::Offset<::flatbuffers::Vector<float>> data_f32 = 0,
+    ::flatbuffers::Offset<::flatbuffers::Vector<uint8_t>> data_u8 = 0,
+    ::flatbuffers::Offset<::flatbuffers::Vector<int8_t>> data_i8 = 0) {
+  TensorBuilder builder_(_fbb);
+  builder_.add_data_i8(data_i8);
+  builder_.add_data_u8(data_u8);
+  builder_.add_data_f32(data_f32);
+  builder_.add_zero_point(zero_point);
+  builder_.add_scale(scale);
+  builder_.add_shape(shape);
+  builder_.add_type(type);
+  return builder_.Finish();
+}
+
+inline ::flatbuffers::Offset<Tensor> CreateTensorDirect(
+    ::flatbuffers::FlatBufferBuilder &_fbb,
+    const std::vector<uint32_t> *shape = nullptr,
+    output_tensor::TensorType type = output_tensor::TensorType_Float32,
+    float scale = 0.0f,
+    int32_t zero_point = 0,
+    const std::vector<float> *data_f32 = nullptr,
+    const std::vector<uint8_t> *data_u8 = nullptr,
+    const std::vector<int8_t> *data_i8 = nullptr) {
+  auto shape__ = shape ? _fbb.CreateVector<uint32_t>(*shape) : 0;
+  auto data_f32__ = data_f32 ? _fbb.CreateVector<float>(*data_f32) : 0;
+  auto data_u8__ = data_u8 ? _fbb.CreateVector<uint8_t>(*data_u8) : 0;
+  auto data_i8__ = data_i8 ? _fbb.CreateVector<int8_t>(*data_i8) : 0;
+  return output_tensor::CreateTensor(
+      _fbb,
+      shape__,
+      type,
+      scale,
+      zero_point,
+      data_f32__,
+      data_u8__,
+      data_i8__);
+}
+
 struct OutputTensor FLATBUFFERS_FINAL_CLASS : private ::flatbuffers::Table {
   typedef OutputTensorBuilder Builder;
   enum FlatBuffersVTableOffset FLATBUFFERS_VTABLE_UNDERLYING_TYPE {
-    VT_DATA = 4
+    VT_DATA = 4,
+    VT_TENSORS = 6,
+    VT_FRAME_ID = 8,
+    VT_TIMESTAMP = 10,
+    VT_INPUT_WIDTH = 12,
+    VT_INPUT_HEIGHT = 14,
+    VT_STREAM_ID = 16
   };
   const ::flatbuffers::Vector<float> *data() const {
     return GetPointer<const ::flatbuffers::Vector<float> *>(VT_DATA);
   }
+  const ::flatbuffers::Vector<::flatbuffers::Offset<output_tensor::Tensor>> *tensors() const {
+    return GetPointer<const ::flatbuffers::Vector<::flatbuffers::Offset<output_tensor::Tensor>> *>(VT_TENSORS);
+  }
+  uint32_t frame_id() const {
+    return GetField<uint32_t>(VT_FRAME_ID, 0);
+  }
+  uint64_t timestamp() const {
+    return GetField<uint64_t>(VT_TIMESTAMP, 0);
+  }
+  uint32_t input_width() const {
+    return GetField<uint32_t>(VT_INPUT_WIDTH, 0);
+  }
+  uint32_t input_height() const {
+    return GetField<uint32_t>(VT_INPUT_HEIGHT, 0);
+  }
+  uint32_t stream_id() const {
+    return GetField<uint32_t>(VT_STREAM_ID, 0);
+  }
   bool Verify(::flatbuffers::Verifier &verifier) const {
     return VerifyTableStart(verifier) &&
            VerifyOffset(verifier, VT_DATA) &&
            verifier.VerifyVector(data()) &&
+           VerifyOffset(verifier, VT_TENSORS) &&
+           verifier.VerifyVector(tensors()) &&
+           verifier.VerifyVectorOfTables(tensors()) &&
+           VerifyField<uint32_t>(verifier, VT_FRAME_ID, 4) &&
+           VerifyField<uint64_t>(verifier, VT_TIMESTAMP, 8) &&
+           VerifyField<uint32_t>(verifier, VT_INPUT_WIDTH, 4) &&
+           VerifyField<uint32_t>(verifier, VT_INPUT_HEIGHT, 4) &&
+           VerifyField<uint32_t>(verifier, VT_STREAM_ID, 4) &&
            verifier.EndTable();
   }
 };
@@ -41,6 +238,24 @@ struct OutputTensorBuilder {
   void add_data(::flatbuffers::Offset<::flatbuffers::Vector<float>> data) {
     fbb_.AddOffset(OutputTensor::VT_DATA, data);
   }
+  void add_tensors(::flatbuffers::Offset<::flatbuffers::Vector<::flatbuffers::Offset<output_tensor::Tensor>>> tensors) {
+    fbb_.AddOffset(OutputTensor::VT_TENSORS, tensors);
+  }
+  void add_frame_id(uint32_t frame_id) {
+    fbb_.AddElement<uint32_t>(OutputTensor::VT_FRAME_ID, frame_id, 0);
+  }
+  void add_timestamp(uint64_t timestamp) {
+    fbb_.AddElement<uint64_t>(OutputTensor::VT_TIMESTAMP, timestamp, 0);
+  }
+  void add_input_width(uint32_t input_width) {
+    fbb_.AddElement<uint32_t>(OutputTensor::VT_INPUT_WIDTH, input_width, 0);
+  }
+  void add_input_height(uint32_t input_height) {
+    fbb_.AddElement<uint32_t>(OutputTensor::VT_INPUT_HEIGHT, input_height, 0);
+  }
+  void add_stream_id(uint32_t stream_id) {
+    fbb_.AddElement<uint32_t>(OutputTensor::VT_STREAM_ID, stream_id, 0);
+  }
   explicit OutputTensorBuilder(::flatbuffers::FlatBufferBuilder &_fbb)
         : fbb_(_fbb) {
     start_ = fbb_.StartTable();
@@ -54,19 +269,44 @@ struct OutputTensorBuilder {
 
 inline ::flatbuffers::Offset<OutputTensor> CreateOutputTensor(
     ::flatbuffers::FlatBufferBuilder &_fbb,
-    ::flatbuffers::Offset<::flatbuffers::Vector<float>> data = 0) {
+    ::flatbuffers::Offset<::flatbuffers::Vector<float>> data = 0,
+    ::flatbuffers::Offset<::flatbuffers::Vector<::flatbuffers::Offset<output_tensor::Tensor>>> tensors = 0,
+    uint32_t frame_id = 0,
+    uint64_t timestamp = 0,
+    uint32_t input_width = 0,
+    uint32_t input_height = 0,
+    uint32_t stream_id = 0) {
   OutputTensorBuilder builder_(_fbb);
+  builder_.add_timestamp(timestamp);
+  builder_.add_stream_id(stream_id);
+  builder_.add_input_height(input_height);
+  builder_.add_input_width(input_width);
+  builder_.add_frame_id(frame_id);
+  builder_.add_tensors(tensors);
   builder_.add_data(data);
   return builder_.Finish();
 }
 
 inline ::flatbuffers::Offset<OutputTensor> CreateOutputTensorDirect(
     ::flatbuffers::FlatBufferBuilder &_fbb,
-    const std::vector<float> *data = nullptr) {
+    const std::vector<float> *data = nullptr,
+    const std::vector<::flatbuffers::Offset<output_tensor::Tensor>> *tensors = nullptr,
+    uint32_t frame_id = 0,
+    uint64_t timestamp = 0,
+    uint32_t input_width = 0,
+    uint32_t input_height = 0,
+    uint32_t stream_id = 0) {
   auto data__ = data ? _fbb.CreateVector<float>(*data) : 0;
+  auto tensors__ = tensors ? _fbb.CreateVector<::flatbuffers::Offset<output_tensor::Tensor>>(*tensors) : 0;
   return output_tensor::CreateOutputTensor(
       _fbb,
-      data__);
+      data__,
+      tensors__,
+      frame_id,
+      timestamp,
+      input_width,
+      input_height,
+      stream_id);
 }
 
 inline const output_tensor::OutputTensor *GetOutputTensor(const void *buf) {
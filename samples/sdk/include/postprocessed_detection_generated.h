@@ -89,15 +89,53 @@ FLATBUFFERS_STRUCT_END(DetectionAnn, 24);
 struct Detection FLATBUFFERS_FINAL_CLASS : private ::flatbuffers::Table {
   typedef DetectionBuilder Builder;
   enum FlatBuffersVTableOffset FLATBUFFERS_VTABLE_UNDERLYING_TYPE {
-    VT_ANNOTATIONS = 4
+    VT_ANNOTATIONS = 4,
+    VT_FRAME_ID = 6,
+    VT_TIMESTAMP = 8,
+    VT_STREAM_ID = 10,
+    VT_TRACK_IDS = 12,
+    VT_INFERRED = 14,
+    VT_CASCADE_CLASSES = 16,
+    VT_CASCADE_SCORES = 18
   };
   const ::flatbuffers::Vector<const postprocessed::DetectionAnn *> *annotations() const {
     return GetPointer<const ::flatbuffers::Vector<const postprocessed::DetectionAnn *> *>(VT_ANNOTATIONS);
   }
+  uint32_t frame_id() const {
+    return GetField<uint32_t>(VT_FRAME_ID, 0);
+  }
+  uint64_t timestamp() const {
+    return GetField<uint64_t>(VT_TIMESTAMP, 0);
+  }
+  uint32_t stream_id() const {
+    return GetField<uint32_t>(VT_STREAM_ID, 0);
+  }
+  const ::flatbuffers::Vector<uint32_t> *track_ids() const {
+    return GetPointer<const ::flatbuffers::Vector<uint32_t> *>(VT_TRACK_IDS);
+  }
+  bool inferred() const {
+    return GetField<uint8_t>(VT_INFERRED, 1) != 0;
+  }
+  const ::flatbuffers::Vector<uint32_t> *cascade_classes() const {
+    return GetPointer<const ::flatbuffers::Vector<uint32_t> *>(VT_CASCADE_CLASSES);
+  }
+  const ::flatbuffers::Vector<float> *cascade_scores() const {
+    return GetPointer<const ::flatbuffers::Vector<float> *>(VT_CASCADE_SCORES);
+  }
   bool Verify(::flatbuffers::Verifier &verifier) const {
     return VerifyTableStart(verifier) &&
            VerifyOffset(verifier, VT_ANNOTATIONS) &&
            verifier.VerifyVector(annotations()) &&
+           VerifyField<uint32_t>(verifier, VT_FRAME_ID, 4) &&
+           VerifyField<uint64_t>(verifier, VT_TIMESTAMP, 8) &&
+           VerifyField<uint32_t>(verifier, VT_STREAM_ID, 4) &&
+           VerifyOffset(verifier, VT_TRACK_IDS) &&
+           verifier.VerifyVector(track_ids()) &&
+           VerifyField<uint8_t>(verifier, VT_INFERRED, 1) &&
+           VerifyOffset(verifier, VT_CASCADE_CLASSES) &&
+           verifier.VerifyVector(cascade_classes()) &&
+           VerifyOffset(verifier, VT_CASCADE_SCORES) &&
+           verifier.VerifyVector(cascade_scores()) &&
            verifier.EndTable();
   }
 };
@@ -109,6 +147,27 @@ struct DetectionBuilder {
   void add_annotations(::flatbuffers::Offset<::flatbuffers::Vector<const postprocessed::DetectionAnn *>> annotations) {
     fbb_.AddOffset(Detection::VT_ANNOTATIONS, annotations);
   }
+  void add_frame_id(uint32_t frame_id) {
+    fbb_.AddElement<uint32_t>(Detection::VT_FRAME_ID, frame_id, 0);
+  }
+  void add_timestamp(uint64_t timestamp) {
+    fbb_.AddElement<uint64_t>(Detection::VT_TIMESTAMP, timestamp, 0);
+  }
+  void add_stream_id(uint32_t stream_id) {
+    fbb_.AddElement<uint32_t>(Detection::VT_STREAM_ID, stream_id, 0);
+  }
+  void add_track_ids(::flatbuffers::Offset<::flatbuffers::Vector<uint32_t>> track_ids) {
+    fbb_.AddOffset(Detection::VT_TRACK_IDS, track_ids);
+  }
+  void add_inferred(bool inferred) {
+    fbb_.AddElement<uint8_t>(Detection::VT_INFERRED, static_cast<uint8_t>(inferred), 1);
+  }
+  void add_cascade_classes(::flatbuffers::Offset<::flatbuffers::Vector<uint32_t>> cascade_classes) {
+    fbb_.AddOffset(Detection::VT_CASCADE_CLASSES, cascade_classes);
+  }
+  void add_cascade_scores(::flatbuffers::Offset<::flatbuffers::Vector<float>> cascade_scores) {
+    fbb_.AddOffset(Detection::VT_CASCADE_SCORES, cascade_scores);
+  }
   explicit DetectionBuilder(::flatbuffers::FlatBufferBuilder &_fbb)
         : fbb_(_fbb) {
     start_ = fbb_.StartTable();
@@ -122,19 +181,50 @@ struct DetectionBuilder {
 
 inline ::flatbuffers::Offset<Detection> CreateDetection(
     ::flatbuffers::FlatBufferBuilder &_fbb,
-    ::flatbuffers::Offset<::flatbuffers::Vector<const postprocessed::DetectionAnn *>> annotations = 0) {
+    ::flatbuffers::Offset<::flatbuffers::Vector<const postprocessed::DetectionAnn *>> annotations = 0,
+    uint32_t frame_id = 0,
+    uint64_t timestamp = 0,
+    uint32_t stream_id = 0,
+    ::flatbuffers::Offset<::flatbuffers::Vector<uint32_t>> track_ids = 0,
+    bool inferred = true,
+    ::flatbuffers::Offset<::flatbuffers::Vector<uint32_t>> cascade_classes = 0,
+    ::flatbuffers::Offset<::flatbuffers::Vector<float>> cascade_scores = 0) {
   DetectionBuilder builder_(_fbb);
+  builder_.add_timestamp(timestamp);
+  builder_.add_cascade_scores(cascade_scores);
+  builder_.add_cascade_classes(cascade_classes);
+  builder_.add_track_ids(track_ids);
+  builder_.add_stream_id(stream_id);
+  builder_.add_frame_id(frame_id);
   builder_.add_annotations(annotations);
+  builder_.add_inferred(inferred);
   return builder_.Finish();
 }
 
 inline ::flatbuffers::Offset<Detection> CreateDetectionDirect(
     ::flatbuffers::FlatBufferBuilder &_fbb,
-    const std::vector<postprocessed::DetectionAnn> *annotations = nullptr) {
+    const std::vector<postprocessed::DetectionAnn> *annotations = nullptr,
+    uint32_t frame_id = 0,
+    uint64_t timestamp = 0,
+    uint32_t stream_id = 0,
+    const std::vector<uint32_t> *track_ids = nullptr,
+    bool inferred = true,
+    const std::vector<uint32_t> *cascade_classes = nullptr,
+    const std::vector<float> *cascade_scores = nullptr) {
   auto annotations__ = annotations ? _fbb.CreateVectorOfStructs<postprocessed::DetectionAnn>(*annotations) : 0;
+  auto track_ids__ = track_ids ? _fbb.CreateVector<uint32_t>(*track_ids) : 0;
+  auto cascade_classes__ = cascade_classes ? _fbb.CreateVector<uint32_t>(*cascade_classes) : 0;
+  auto cascade_scores__ = cascade_scores ? _fbb.CreateVector<float>(*cascade_scores) : 0;
   return postprocessed::CreateDetection(
       _fbb,
-      annotations__);
+      annotations__,
+      frame_id,
+      timestamp,
+      stream_id,
+      track_ids__,
+      inferred,
+      cascade_classes__,
+      cascade_scores__);
 }
 
 inline const postprocessed::Detection *GetDetection(const void *buf) {
@@ -0,0 +1,81 @@
+#ifndef RASTER_H
+#define RASTER_H
+
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+typedef struct {
+    uint8_t r;
+    uint8_t g;
+    uint8_t b;
+} raster_color_t;
+
+// Packed RGB24 image drawn in place
+typedef struct {
+    uint8_t *data;
+    uint32_t width;
+    uint32_t height;
+} raster_image_t;
+
+// Coordinates are inclusive and clipped to the image, so callers can pass
+// boxes that stick out of it.
+
+void raster_hline(const raster_image_t *img, int32_t x0, int32_t x1,
+                  int32_t y, raster_color_t color);
+
+void raster_vline(const raster_image_t *img, int32_t x, int32_t y0,
+                  int32_t y1, raster_color_t color);
+
+void raster_fill_rect(const raster_image_t *img, int32_t x0, int32_t y0,
+                      int32_t x1, int32_t y1, raster_color_t color);
+
+/**
+ * Outline of a rectangle, `thickness` pixels wide, growing inwards from
+ * the given corners.
+ */
+void raster_rect(const raster_image_t *img, int32_t x0, int32_t y0,
+                 int32_t x1, int32_t y1, uint32_t thickness,
+                 raster_color_t color);
+
+/**
+ * Blend a filled rectangle over the image. `alpha` is the opacity in
+ * 1/256 steps: 0 leaves the image untouched and 256 paints over it.
+ */
+void raster_blend_rect(const raster_image_t *img, int32_t x0, int32_t y0,
+                       int32_t x1, int32_t y1, raster_color_t color,
+                       uint32_t alpha);
+
+// Built-in ASCII font: 5x7 glyphs, one pixel apart
+#define RASTER_GLYPH_WIDTH   5
+#define RASTER_GLYPH_HEIGHT  7
+#define RASTER_GLYPH_ADVANCE (RASTER_GLYPH_WIDTH + 1)
+
+/**
+ * Width in pixels of `text` drawn with raster_text().
+ */
+uint32_t raster_text_width(const char *text);
+
+/**
+ * Draw the set pixels of `text` with its top-left corner at (x, y); the
+ * background is left untouched. Characters outside printable ASCII are
+ * drawn as '?'.
+ */
+void raster_text(const raster_image_t *img, int32_t x, int32_t y,
+                 const char *text, raster_color_t color);
+
+/**
+ * Label for a box whose top-left corner is (x, y): `text` in black or
+ * white, whichever reads better, on a tab filled with `background`. The tab
+ * sits on top of the box, or just inside it when there is no room above.
+ */
+void raster_label(const raster_image_t *img, int32_t x, int32_t y,
+                  const char *text, raster_color_t background);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -0,0 +1,37 @@
+#ifndef SHA256_H
+#define SHA256_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define SHA256_DIGEST_SIZE 32
+// Lower-case hex digest plus terminator
+#define SHA256_HEX_SIZE (SHA256_DIGEST_SIZE * 2 + 1)
+
+typedef struct {
+    uint32_t state[8];
+    uint64_t length;
+    uint8_t block[64];
+    uint32_t used;
+} sha256_t;
+
+void sha256_init(sha256_t *ctx);
+void sha256_update(sha256_t *ctx, const void *data, size_t len);
+void sha256_final(sha256_t *ctx, uint8_t digest[SHA256_DIGEST_SIZE]);
+
+/**
+ * Hash the file at `path` into a hex string.
+ *
+ * @return 0 on success, -1 if the file cannot be read.
+ */
+int sha256_file_hex(const char *path, char hex[SHA256_HEX_SIZE]);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
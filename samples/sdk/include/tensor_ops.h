@@ -0,0 +1,56 @@
+#ifndef TENSOR_OPS_H
+#define TENSOR_OPS_H
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**
+ * Normalize `n` uint8 samples into [0, 1] floats (x / 255).
+ */
+void tensor_normalize_u8(const uint8_t *src, float *dst, uint32_t n);
+
+/**
+ * Count the leading elements of `values` that are >= `threshold`, stopping
+ * at the first one below it. Scores coming out of the SSD postprocess op are
+ * sorted, so this is the number of detections above the threshold.
+ */
+uint32_t tensor_count_leading_ge(const float *values, uint32_t n,
+                                 float threshold);
+
+/**
+ * Store the positions of the elements of `values` that are >= `threshold`
+ * in `indices`, up to `max` of them.
+ *
+ * @return the number of positions stored.
+ */
+uint32_t tensor_find_ge(const float *values, uint32_t n, float threshold,
+                        uint32_t *indices, uint32_t max);
+
+/**
+ * Shift `n` uint8 pixels to the int8 range, p - 128, as two's complement
+ * bytes. `src` and `dst` may be the same.
+ */
+void tensor_u8_to_i8(const uint8_t *src, uint8_t *dst, uint32_t n);
+
+/**
+ * Quantize `n` floats to 8 bits: clamp(round(x / scale) + zero_point). For
+ * int8 (`is_signed`) the output holds the two's complement bytes.
+ */
+void tensor_quantize_f32(const float *src, uint8_t *dst, uint32_t n,
+                         float scale, int32_t zero_point, bool is_signed);
+
+/**
+ * Inverse of tensor_quantize_f32(): (q - zero_point) * scale.
+ */
+void tensor_dequantize_8(const uint8_t *src, float *dst, uint32_t n,
+                         float scale, int32_t zero_point, bool is_signed);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
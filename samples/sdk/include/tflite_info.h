@@ -0,0 +1,62 @@
+#ifndef TFLITE_INFO_H
+#define TFLITE_INFO_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define TFLITE_MAX_DIMS 8
+
+// Subset of tflite::TensorType
+typedef enum {
+    TFLITE_FLOAT32 = 0,
+    TFLITE_FLOAT16 = 1,
+    TFLITE_INT32 = 2,
+    TFLITE_UINT8 = 3,
+    TFLITE_INT64 = 4,
+    TFLITE_INT16 = 7,
+    TFLITE_INT8 = 9,
+} tflite_type_t;
+
+typedef struct {
+    tflite_type_t type;
+    uint32_t num_dims;
+    uint32_t dims[TFLITE_MAX_DIMS];
+    // Per-tensor quantization; scale is 0 when the tensor is not quantized.
+    float scale;
+    int32_t zero_point;
+    // The shape signature leaves the first dimension open, so the runtime
+    // may take any batch size; dims[0] then holds 1.
+    bool dynamic_batch;
+} tflite_tensor_info_t;
+
+/**
+ * Read the description of input tensor `index` of the main subgraph straight
+ * from a TFLite flatbuffer. wasi-nn has no call to query it from the runtime.
+ *
+ * @return 0 on success, -1 if the buffer is not a valid model or the tensor
+ * does not exist.
+ */
+int tflite_input_info(const uint8_t *model, size_t size, uint32_t index,
+                      tflite_tensor_info_t *info);
+
+/**
+ * Same as tflite_input_info() for output tensor `index`.
+ */
+int tflite_output_info(const uint8_t *model, size_t size, uint32_t index,
+                       tflite_tensor_info_t *info);
+
+/**
+ * Number of elements described by `info->dims`.
+ */
+uint32_t tflite_num_elements(const tflite_tensor_info_t *info);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
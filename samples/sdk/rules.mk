@@ -10,7 +10,17 @@ PROJ_LDFLAGS = \
 
 BINDIR = ../bin
 
+# Sources shared between modules
+SDKSRCDIR = $(PROJECTDIR)/sdk/src
+vpath %.c $(SDKSRCDIR)
+vpath %.cpp $(SDKSRCDIR)
+
 CFLAGS =
+# `make SIMD=1` builds the WASM SIMD128 variant of the pixel and tensor
+# kernels; the default build uses their scalar fallbacks.
+ifeq ($(SIMD),1)
+CFLAGS += -msimd128
+endif
 CINCLUDES = \
 	-I$(PROJECTDIR)/sdk/include
 PROJ_CFLAGS = \
@@ -29,6 +39,18 @@ all:
 
 FORCE:
 
+# Variant the objects were last built for, recorded by the project
+# Makefiles, whose nodes depend on `variant`: switching variants cleans
+# the objects of the other one first.
+VARIANT = $(if $(filter 1,$(SIMD)),simd,scalar)
+VARIANT_STAMP = .variant
+
+variant:
+	@if [ "`cat $(VARIANT_STAMP) 2>/dev/null`" != $(VARIANT) ]; then\
+		$(MAKE) clean;\
+		echo $(VARIANT) > $(VARIANT_STAMP);\
+	fi
+
 .SUFFIXES: .c .o .cpp
 
 .c.o:
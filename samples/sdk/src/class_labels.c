@@ -0,0 +1,108 @@
+#include "class_labels.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+#include "logger.h"
+
+// All names in one allocation, with `names` pointing into it
+static char *storage = NULL;
+static const char *names[CLASS_LABELS_MAX];
+
+int
+class_labels_load(const JSON_Array *array)
+{
+    size_t count = json_array_get_count(array);
+    if (count > CLASS_LABELS_MAX) {
+        LOG_WARN("Only the first %d class names are used", CLASS_LABELS_MAX);
+        count = CLASS_LABELS_MAX;
+    }
+    size_t total = 0;
+    for (size_t i = 0; i < count; ++i) {
+        const char *s = json_array_get_string(array, i);
+        if (s != NULL)
+            total += strlen(s) + 1;
+    }
+    char *p = malloc(total > 0 ? total : 1);
+    if (p == NULL) {
+        LOG_ERR("Cannot allocate %zu bytes for class names", total);
+        return -1;
+    }
+
+    class_labels_free();
+    storage = p;
+    for (size_t i = 0; i < count; ++i) {
+        const char *s = json_array_get_string(array, i);
+        if (s == NULL)
+            continue;
+        size_t len = strlen(s) + 1;
+        memcpy(p, s, len);
+        names[i] = p;
+        p += len;
+    }
+    LOG_INFO("Loaded %zu class names", count);
+    return 0;
+}
+
+const char *
+class_labels_name(uint32_t cls)
+{
+    return cls < CLASS_LABELS_MAX ? names[cls] : NULL;
+}
+
+size_t
+class_labels_append_uint(char *buf, size_t len, size_t size, uint32_t v)
+{
+    char digits[10];
+    int n = 0;
+    do {
+        digits[n++] = '0' + v % 10;
+        v /= 10;
+    } while (v != 0);
+    while (n > 0 && len + 1 < size)
+        buf[len++] = digits[--n];
+    return len;
+}
+
+size_t
+class_labels_format(char *buf, size_t size, uint32_t cls, float score)
+{
+    if (size == 0)
+        return 0;
+    // Called for every box, so no snprintf. Long names are cut to leave
+    // room for " 100%".
+    size_t len = 0;
+    size_t name_size = size > 6 ? size - 5 : 1;
+    const char *name = class_labels_name(cls);
+    if (name != NULL) {
+        while (*name != '\0' && len + 1 < name_size)
+            buf[len++] = *name++;
+    } else {
+        len = class_labels_append_uint(buf, len, size, cls);
+    }
+    if (len + 1 < size)
+        buf[len++] = ' ';
+    len = class_labels_append_score(buf, len, size, score);
+    buf[len] = '\0';
+    return len;
+}
+
+size_t
+class_labels_append_score(char *buf, size_t len, size_t size, float score)
+{
+    uint32_t percent = score <= 0   ? 0
+                       : score >= 1 ? 100
+                                    : (uint32_t)(score * 100 + 0.5f);
+    len = class_labels_append_uint(buf, len, size, percent);
+    if (len + 1 < size)
+        buf[len++] = '%';
+    return len;
+}
+
+void
+class_labels_free(void)
+{
+    free(storage);
+    storage = NULL;
+    memset(names, 0, sizeof(names));
+}
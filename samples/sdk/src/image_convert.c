@@ -0,0 +1,400 @@
+#include "image_convert.h"
+
+#include <stdbool.h>
+#include <stdlib.h>
+#include <string.h>
+
+#ifdef __wasm_simd128__
+#include <wasm_simd128.h>
+#endif
+
+// BT.601 limited range, same fixed-point coefficients as OpenCV's
+// CV_YUV2BGR_YUYV path so the output matches the previous cvCvtColor result.
+#define YUV_SHIFT 20
+#define YUV_CY    1220542
+#define YUV_CUB   2116026
+#define YUV_CUG   -409993
+#define YUV_CVG   -852492
+#define YUV_CVR   1673527
+
+// Bilinear weights, in 1/256 of a pixel
+#define BILINEAR_SHIFT 8
+#define BILINEAR_ONE   (1 << BILINEAR_SHIFT)
+
+static inline uint8_t
+clamp_u8(int32_t v)
+{
+    return v < 0 ? 0 : (v > 255 ? 255 : (uint8_t)v);
+}
+
+static inline void
+yuv_to_rgb(uint8_t y, uint8_t u, uint8_t v, uint8_t *rgb)
+{
+    int32_t yy = (y > 16 ? y - 16 : 0) * YUV_CY;
+    int32_t uu = (int32_t)u - 128;
+    int32_t vv = (int32_t)v - 128;
+    int32_t round = 1 << (YUV_SHIFT - 1);
+
+    rgb[0] = clamp_u8((yy + round + YUV_CVR * vv) >> YUV_SHIFT);
+    rgb[1] = clamp_u8((yy + round + YUV_CVG * vv + YUV_CUG * uu) >> YUV_SHIFT);
+    rgb[2] = clamp_u8((yy + round + YUV_CUB * uu) >> YUV_SHIFT);
+}
+
+int
+image_src_init(image_src_t *src, const uint8_t *buf, uint32_t width,
+               uint32_t height, uint32_t stride, const char *pixel_format)
+{
+    src->data = buf;
+    src->width = width;
+    src->height = height;
+    if (strcmp(pixel_format, "image_nv16") == 0) {
+        src->format = IMAGE_FORMAT_NV16;
+        src->stride = stride ? stride : width;
+        src->uv = buf + src->stride * height;
+    } else if (strcmp(pixel_format, "image_rgb24") == 0) {
+        src->format = IMAGE_FORMAT_RGB24;
+        src->stride = stride ? stride : width * 3;
+        src->uv = NULL;
+    } else {
+        return -1;
+    }
+    return 0;
+}
+
+#ifdef __wasm_simd128__
+// One colour channel for 8 pixels: (y + cu * u + cv * v) >> YUV_SHIFT, where
+// ylo/yhi already hold the scaled and rounded luma term.
+static inline v128_t
+yuv_channel_x8(v128_t ylo, v128_t yhi, v128_t u, v128_t v, int32_t cu,
+               int32_t cv)
+{
+    v128_t lo = wasm_i32x4_add(
+        ylo, wasm_i32x4_add(wasm_i32x4_mul(wasm_i32x4_extend_low_i16x8(u),
+                                           wasm_i32x4_splat(cu)),
+                            wasm_i32x4_mul(wasm_i32x4_extend_low_i16x8(v),
+                                           wasm_i32x4_splat(cv))));
+    v128_t hi = wasm_i32x4_add(
+        yhi, wasm_i32x4_add(wasm_i32x4_mul(wasm_i32x4_extend_high_i16x8(u),
+                                           wasm_i32x4_splat(cu)),
+                            wasm_i32x4_mul(wasm_i32x4_extend_high_i16x8(v),
+                                           wasm_i32x4_splat(cv))));
+    return wasm_i16x8_narrow_i32x4(wasm_i32x4_shr(lo, YUV_SHIFT),
+                                   wasm_i32x4_shr(hi, YUV_SHIFT));
+}
+
+// Convert 8 gathered Y/Cb/Cr samples and store them as 24 bytes of RGB24.
+static inline void
+yuv_to_rgb_x8(const uint8_t *ys, const uint8_t *us, const uint8_t *vs,
+              uint8_t *rgb)
+{
+    v128_t y =
+        wasm_u16x8_sub_sat(wasm_u16x8_load8x8(ys), wasm_i16x8_splat(16));
+    v128_t u = wasm_i16x8_sub(wasm_u16x8_load8x8(us), wasm_i16x8_splat(128));
+    v128_t v = wasm_i16x8_sub(wasm_u16x8_load8x8(vs), wasm_i16x8_splat(128));
+
+    const v128_t cy = wasm_i32x4_splat(YUV_CY);
+    const v128_t round = wasm_i32x4_splat(1 << (YUV_SHIFT - 1));
+    v128_t ylo = wasm_i32x4_add(
+        wasm_i32x4_mul(wasm_u32x4_extend_low_u16x8(y), cy), round);
+    v128_t yhi = wasm_i32x4_add(
+        wasm_i32x4_mul(wasm_u32x4_extend_high_u16x8(y), cy), round);
+
+    v128_t r = yuv_channel_x8(ylo, yhi, u, v, 0, YUV_CVR);
+    v128_t g = yuv_channel_x8(ylo, yhi, u, v, YUV_CUG, YUV_CVG);
+    v128_t b = yuv_channel_x8(ylo, yhi, u, v, YUV_CUB, 0);
+
+    // rg = r0..r7 g0..g7, bb = b0..b7 b0..b7, then interleave to RGB24.
+    v128_t rg = wasm_u8x16_narrow_i16x8(r, g);
+    v128_t bb = wasm_u8x16_narrow_i16x8(b, b);
+    v128_t out0 = wasm_i8x16_shuffle(rg, bb, 0, 8, 16, 1, 9, 17, 2, 10, 18, 3,
+                                     11, 19, 4, 12, 20, 5);
+    v128_t out1 = wasm_i8x16_shuffle(rg, bb, 13, 21, 6, 14, 22, 7, 15, 23, 0,
+                                     0, 0, 0, 0, 0, 0, 0);
+    wasm_v128_store(rgb, out0);
+    wasm_v128_store64_lane(rgb + 16, out1, 0);
+}
+#endif
+
+static void
+convert_row_nv16(const image_src_t *src, uint32_t sy, uint8_t *dst,
+                 uint32_t dst_width)
+{
+    const uint8_t *y_row = src->data + sy * src->stride;
+    const uint8_t *uv_row = src->uv + sy * src->stride;
+    uint32_t step = src->width / dst_width;
+    uint32_t frac = src->width % dst_width;
+    uint32_t sx = 0, err = 0;
+    uint32_t dx = 0;
+
+#ifdef __wasm_simd128__
+    // The nearest-neighbour gather stays scalar; the colour math runs on
+    // eight pixels at a time.
+    for (; dx + 8 <= dst_width; dx += 8) {
+        uint8_t ys[8], us[8], vs[8];
+        for (int k = 0; k < 8; ++k) {
+            uint32_t c = sx & ~1u;
+            ys[k] = y_row[sx];
+            us[k] = uv_row[c];
+            vs[k] = uv_row[c + 1];
+
+            sx += step;
+            err += frac;
+            if (err >= dst_width) {
+                err -= dst_width;
+                ++sx;
+            }
+        }
+        yuv_to_rgb_x8(ys, us, vs, dst);
+        dst += 24;
+    }
+#endif
+    for (; dx < dst_width; ++dx) {
+        // Each Cb/Cr pair is shared by the two luma samples of a YUYV pair.
+        uint32_t c = sx & ~1u;
+        yuv_to_rgb(y_row[sx], uv_row[c], uv_row[c + 1], dst);
+        dst += 3;
+
+        sx += step;
+        err += frac;
+        if (err >= dst_width) {
+            err -= dst_width;
+            ++sx;
+        }
+    }
+}
+
+static void
+convert_row_rgb24(const image_src_t *src, uint32_t sy, uint8_t *dst,
+                  uint32_t dst_width)
+{
+    const uint8_t *row = src->data + sy * src->stride;
+    if (src->width == dst_width) {
+        memcpy(dst, row, dst_width * 3);
+        return;
+    }
+
+    uint32_t step = src->width / dst_width;
+    uint32_t frac = src->width % dst_width;
+    uint32_t sx = 0, err = 0;
+
+    for (uint32_t dx = 0; dx < dst_width; ++dx) {
+        const uint8_t *p = row + sx * 3;
+        dst[0] = p[0];
+        dst[1] = p[1];
+        dst[2] = p[2];
+        dst += 3;
+
+        sx += step;
+        err += frac;
+        if (err >= dst_width) {
+            err -= dst_width;
+            ++sx;
+        }
+    }
+}
+
+void
+image_convert_rgb24(const image_src_t *src, uint8_t *dst, uint32_t dst_width,
+                    uint32_t dst_height)
+{
+    uint32_t step = src->height / dst_height;
+    uint32_t frac = src->height % dst_height;
+    uint32_t sy = 0, err = 0;
+
+    for (uint32_t dy = 0; dy < dst_height; ++dy) {
+        if (src->format == IMAGE_FORMAT_NV16)
+            convert_row_nv16(src, sy, dst, dst_width);
+        else
+            convert_row_rgb24(src, sy, dst, dst_width);
+        dst += dst_width * 3;
+
+        sy += step;
+        err += frac;
+        if (err >= dst_height) {
+            err -= dst_height;
+            ++sy;
+        }
+    }
+}
+
+// Horizontal sample of the bilinear fits: byte offsets of the two source
+// pixels and the weight of the second.
+typedef struct {
+    uint32_t off0;
+    uint32_t off1;
+    uint32_t frac;
+} bilinear_tap_t;
+
+// Grown on demand and kept, so a frame does not allocate after the first.
+static uint8_t *scratch = NULL;
+static size_t scratch_size = 0;
+
+static uint8_t *
+scratch_reserve(size_t size)
+{
+    if (size > scratch_size) {
+        uint8_t *p = realloc(scratch, size);
+        if (p == NULL)
+            return NULL;
+        scratch = p;
+        scratch_size = size;
+    }
+    return scratch;
+}
+
+// Source position of output pixel `d` of `out` pixels spread over `in`
+// source pixels, pixel centres aligned, in 1/256 of a pixel and clamped to
+// the source.
+static void
+bilinear_pos(uint32_t d, uint32_t out, uint32_t in, uint32_t *i0,
+             uint32_t *i1, uint32_t *frac)
+{
+    int64_t pos = ((int64_t)(2 * d + 1) * in - out) * BILINEAR_ONE /
+                  (2 * (int64_t)out);
+    int64_t max = (int64_t)(in - 1) << BILINEAR_SHIFT;
+    pos = pos < 0 ? 0 : pos > max ? max : pos;
+    *i0 = pos >> BILINEAR_SHIFT;
+    *frac = pos & (BILINEAR_ONE - 1);
+    *i1 = *i0 + 1 < in ? *i0 + 1 : *i0;
+}
+
+// RGB24 row `sy` of the source. RGB24 sources are read in place; NV16 rows
+// are converted into `buf`.
+static const uint8_t *
+source_row(const image_src_t *src, uint32_t sy, uint8_t *buf)
+{
+    if (src->format == IMAGE_FORMAT_RGB24)
+        return src->data + sy * src->stride;
+    convert_row_nv16(src, sy, buf, src->width);
+    return buf;
+}
+
+// Resample the source rectangle (rx, ry, rw, rh) into the output rectangle
+// (ox, oy, ow, oh) of `dst`, leaving the rest of `dst` black.
+static void
+convert_bilinear(const image_src_t *src, uint8_t *dst, uint32_t dst_width,
+                 uint32_t dst_height, uint32_t rx, uint32_t ry, uint32_t rw,
+                 uint32_t rh, uint32_t ox, uint32_t oy, uint32_t ow,
+                 uint32_t oh)
+{
+    size_t row_size = (size_t)src->width * 3;
+    uint8_t *buf = scratch_reserve(2 * row_size + ow * sizeof(bilinear_tap_t));
+    if (buf == NULL) {
+        image_convert_rgb24(src, dst, dst_width, dst_height);
+        return;
+    }
+    uint8_t *bufs[2] = {buf, buf + row_size};
+    bilinear_tap_t *taps = (bilinear_tap_t *)(buf + 2 * row_size);
+    for (uint32_t dx = 0; dx < ow; ++dx) {
+        uint32_t i0, i1, frac;
+        bilinear_pos(dx, ow, rw, &i0, &i1, &frac);
+        taps[dx].off0 = (rx + i0) * 3;
+        taps[dx].off1 = (rx + i1) * 3;
+        taps[dx].frac = frac;
+    }
+
+    size_t stride = (size_t)dst_width * 3;
+    memset(dst, 0, oy * stride);
+    memset(dst + (oy + oh) * stride, 0, (dst_height - oy - oh) * stride);
+
+    // Source rows held in bufs; consecutive output rows mostly share them.
+    int64_t held[2] = {-1, -1};
+    const uint8_t *rows[2] = {NULL, NULL};
+    for (uint32_t dy = 0; dy < oh; ++dy) {
+        uint32_t y0, y1, fy;
+        bilinear_pos(dy, oh, rh, &y0, &y1, &fy);
+        int64_t sy0 = ry + y0, sy1 = ry + y1;
+        if (held[0] != sy0) {
+            if (held[1] == sy0) {
+                // Moving down: the bottom row becomes the top one.
+                uint8_t *b = bufs[0];
+                bufs[0] = bufs[1];
+                bufs[1] = b;
+                rows[0] = rows[1];
+                held[1] = -1;
+            } else {
+                rows[0] = source_row(src, sy0, bufs[0]);
+            }
+            held[0] = sy0;
+        }
+        if (sy1 == sy0) {
+            rows[1] = rows[0];
+            held[1] = -1;
+        } else if (held[1] != sy1) {
+            rows[1] = source_row(src, sy1, bufs[1]);
+            held[1] = sy1;
+        }
+
+        uint8_t *out = dst + (oy + dy) * stride;
+        memset(out, 0, ox * 3);
+        memset(out + (ox + ow) * 3, 0, (dst_width - ox - ow) * 3);
+        out += ox * 3;
+        const uint32_t wy1 = fy, wy0 = BILINEAR_ONE - fy;
+        for (uint32_t dx = 0; dx < ow; ++dx, out += 3) {
+            const bilinear_tap_t *t = &taps[dx];
+            const uint32_t wx1 = t->frac, wx0 = BILINEAR_ONE - t->frac;
+            for (int c = 0; c < 3; ++c) {
+                uint32_t top =
+                    rows[0][t->off0 + c] * wx0 + rows[0][t->off1 + c] * wx1;
+                uint32_t bottom =
+                    rows[1][t->off0 + c] * wx0 + rows[1][t->off1 + c] * wx1;
+                out[c] = (top * wy0 + bottom * wy1 +
+                          (1 << (2 * BILINEAR_SHIFT - 1))) >>
+                         (2 * BILINEAR_SHIFT);
+            }
+        }
+    }
+}
+
+void
+image_convert_rgb24_fit(const image_src_t *src, uint8_t *dst,
+                        uint32_t dst_width, uint32_t dst_height,
+                        image_fit_t fit)
+{
+    uint32_t sw = src->width, sh = src->height;
+    // The source is wider than the output when sw / sh > dw / dh.
+    bool wider = (uint64_t)sw * dst_height > (uint64_t)sh * dst_width;
+    switch (fit) {
+    case IMAGE_FIT_LETTERBOX: {
+        uint32_t ow = dst_width, oh = dst_height;
+        if (wider)
+            oh = ((uint64_t)sh * dst_width + sw / 2) / sw;
+        else
+            ow = ((uint64_t)sw * dst_height + sh / 2) / sh;
+        ow = ow == 0 ? 1 : ow;
+        oh = oh == 0 ? 1 : oh;
+        convert_bilinear(src, dst, dst_width, dst_height, 0, 0, sw, sh,
+                         (dst_width - ow) / 2, (dst_height - oh) / 2, ow, oh);
+        break;
+    }
+    case IMAGE_FIT_CROP: {
+        uint32_t rw = sw, rh = sh;
+        if (wider)
+            rw = ((uint64_t)sh * dst_width + dst_height / 2) / dst_height;
+        else
+            rh = ((uint64_t)sw * dst_height + dst_width / 2) / dst_width;
+        rw = rw == 0 ? 1 : rw;
+        rh = rh == 0 ? 1 : rh;
+        convert_bilinear(src, dst, dst_width, dst_height, (sw - rw) / 2,
+                         (sh - rh) / 2, rw, rh, 0, 0, dst_width, dst_height);
+        break;
+    }
+    default:
+        image_convert_rgb24(src, dst, dst_width, dst_height);
+        break;
+    }
+}
+
+int
+image_fit_parse(const char *name, image_fit_t *fit)
+{
+    if (strcmp(name, "stretch") == 0)
+        *fit = IMAGE_FIT_STRETCH;
+    else if (strcmp(name, "letterbox") == 0)
+        *fit = IMAGE_FIT_LETTERBOX;
+    else if (strcmp(name, "crop") == 0)
+        *fit = IMAGE_FIT_CROP;
+    else
+        return -1;
+    return 0;
+}
@@ -0,0 +1,268 @@
+#include "model_cache.h"
+
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "logger.h"
+#include "sha256.h"
+
+#define MANIFEST_NAME "models.manifest"
+#define DOWNLOAD_NAME "model.download"
+
+typedef struct {
+    char sha[SHA256_HEX_SIZE];
+    unsigned long long size;
+    unsigned long long last_used;
+    char *url;
+} cache_entry_t;
+
+static char *cache_dir = NULL;
+static char *download_path = NULL;
+static cache_entry_t *entries = NULL;
+static uint32_t num_entries = 0;
+static uint32_t max_entries = 1;
+
+static char *
+cache_path(const char *name, const char *ext)
+{
+    size_t len = strlen(cache_dir) + strlen(name) + strlen(ext) + 2;
+    char *path = malloc(len);
+    if (path != NULL)
+        snprintf(path, len, "%s/%s%s", cache_dir, name, ext);
+    return path;
+}
+
+static long long
+file_size(const char *path)
+{
+    struct stat st;
+    return stat(path, &st) == 0 ? (long long)st.st_size : -1;
+}
+
+static int
+save_manifest(void)
+{
+    char *path = cache_path(MANIFEST_NAME, "");
+    char *tmp = cache_path(MANIFEST_NAME, ".tmp");
+    int ret = -1;
+    FILE *fp = tmp != NULL ? fopen(tmp, "w") : NULL;
+    if (fp != NULL) {
+        for (uint32_t i = 0; i < num_entries; ++i)
+            fprintf(fp, "%s %llu %llu %s\n", entries[i].sha, entries[i].size,
+                    entries[i].last_used, entries[i].url);
+        // Replace the manifest atomically so a crash keeps the old one.
+        if (fclose(fp) == 0 && rename(tmp, path) == 0)
+            ret = 0;
+    }
+    if (ret != 0)
+        LOG_WARN("Could not write the model cache manifest");
+    free(path);
+    free(tmp);
+    return ret;
+}
+
+static int
+find_entry(const char *url)
+{
+    for (uint32_t i = 0; i < num_entries; ++i) {
+        if (strcmp(entries[i].url, url) == 0)
+            return i;
+    }
+    return -1;
+}
+
+static bool
+sha_in_use(const char *sha)
+{
+    for (uint32_t i = 0; i < num_entries; ++i) {
+        if (strcmp(entries[i].sha, sha) == 0)
+            return true;
+    }
+    return false;
+}
+
+// Drop entry `i`, deleting its file unless another URL maps to the same
+// content.
+static void
+remove_entry(uint32_t i)
+{
+    char sha[SHA256_HEX_SIZE];
+    memcpy(sha, entries[i].sha, sizeof(sha));
+    free(entries[i].url);
+    memmove(&entries[i], &entries[i + 1],
+            (num_entries - i - 1) * sizeof(*entries));
+    --num_entries;
+
+    if (!sha_in_use(sha)) {
+        char *path = cache_path(sha, ".tflite");
+        if (path != NULL)
+            unlink(path);
+        free(path);
+    }
+}
+
+static void
+evict(void)
+{
+    while (num_entries > max_entries) {
+        uint32_t lru = 0;
+        for (uint32_t i = 1; i < num_entries; ++i) {
+            if (entries[i].last_used < entries[lru].last_used)
+                lru = i;
+        }
+        LOG_INFO("Evicting cached model %s (%s)", entries[lru].sha,
+                 entries[lru].url);
+        remove_entry(lru);
+    }
+}
+
+static int
+add_entry(const char *sha, unsigned long long size,
+          unsigned long long last_used, const char *url)
+{
+    cache_entry_t *e = realloc(entries, (num_entries + 1) * sizeof(*e));
+    if (e == NULL)
+        return -1;
+    entries = e;
+    e = &entries[num_entries];
+    e->url = strdup(url);
+    if (e->url == NULL)
+        return -1;
+    snprintf(e->sha, sizeof(e->sha), "%s", sha);
+    e->size = size;
+    e->last_used = last_used;
+    ++num_entries;
+    return 0;
+}
+
+int
+model_cache_init(const char *dir, uint32_t max)
+{
+    model_cache_deinit();
+    cache_dir = strdup(dir);
+    if (cache_dir == NULL)
+        return -1;
+    download_path = cache_path(DOWNLOAD_NAME, "");
+    max_entries = max > 0 ? max : 1;
+
+    char *path = cache_path(MANIFEST_NAME, "");
+    FILE *fp = path != NULL ? fopen(path, "r") : NULL;
+    free(path);
+    if (fp == NULL)
+        return 0;
+
+    char *line = NULL;
+    size_t cap = 0;
+    while (getline(&line, &cap, fp) > 0) {
+        char sha[SHA256_HEX_SIZE];
+        unsigned long long size, last_used;
+        int n = 0;
+        if (sscanf(line, "%64s %llu %llu %n", sha, &size, &last_used, &n) !=
+                3 ||
+            n == 0)
+            continue;
+        line[strcspn(line, "\n")] = '\0';
+
+        char *file = cache_path(sha, ".tflite");
+        bool exists = file != NULL && file_size(file) >= 0;
+        free(file);
+        if (exists && find_entry(line + n) < 0)
+            add_entry(sha, size, last_used, line + n);
+    }
+    free(line);
+    fclose(fp);
+
+    evict();
+    LOG_DBG("Model cache has %u entries", num_entries);
+    return 0;
+}
+
+char *
+model_cache_lookup(const char *url)
+{
+    int i = find_entry(url);
+    if (i < 0)
+        return NULL;
+
+    char *path = cache_path(entries[i].sha, ".tflite");
+    char sha[SHA256_HEX_SIZE];
+    if (path == NULL || file_size(path) != (long long)entries[i].size ||
+        sha256_file_hex(path, sha) != 0 || strcmp(sha, entries[i].sha) != 0) {
+        LOG_WARN("Cached model for %s is corrupt, dropping it", url);
+        // The file does not match its name, so it must go even if shared.
+        if (path != NULL)
+            unlink(path);
+        remove_entry(i);
+        save_manifest();
+        free(path);
+        return NULL;
+    }
+
+    entries[i].last_used = time(NULL);
+    save_manifest();
+    return path;
+}
+
+const char *
+model_cache_download_path(void)
+{
+    return download_path;
+}
+
+char *
+model_cache_insert(const char *url)
+{
+    char sha[SHA256_HEX_SIZE];
+    long long size = file_size(download_path);
+    if (size < 0 || sha256_file_hex(download_path, sha) != 0) {
+        LOG_ERR("Cannot read downloaded model %s", download_path);
+        return NULL;
+    }
+
+    char *path = cache_path(sha, ".tflite");
+    if (path == NULL)
+        return NULL;
+    // Identical content may already be cached under another URL.
+    if (file_size(path) == size)
+        unlink(download_path);
+    else if (rename(download_path, path) != 0) {
+        LOG_ERR("Cannot move downloaded model to %s", path);
+        free(path);
+        return NULL;
+    }
+
+    int i = find_entry(url);
+    if (i >= 0 && strcmp(entries[i].sha, sha) == 0) {
+        entries[i].last_used = time(NULL);
+    } else {
+        if (i >= 0)
+            remove_entry(i);
+        if (add_entry(sha, size, time(NULL), url) != 0) {
+            free(path);
+            return NULL;
+        }
+    }
+    evict();
+    save_manifest();
+    LOG_INFO("Cached model %s (%lld bytes) for %s", sha, size, url);
+    return path;
+}
+
+void
+model_cache_deinit(void)
+{
+    for (uint32_t i = 0; i < num_entries; ++i)
+        free(entries[i].url);
+    free(entries);
+    entries = NULL;
+    num_entries = 0;
+    free(cache_dir);
+    cache_dir = NULL;
+    free(download_path);
+    download_path = NULL;
+}
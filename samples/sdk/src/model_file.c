@@ -0,0 +1,61 @@
+#include "model_file.h"
+
+#include <fcntl.h>
+#include <stdlib.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "logger.h"
+
+uint8_t *
+model_file_read(const char *path, size_t *size)
+{
+    int fd = open(path, O_RDONLY);
+    if (fd < 0) {
+        LOG_ERR("Cannot open %s", path);
+        return NULL;
+    }
+
+    struct stat st;
+    if (fstat(fd, &st) != 0 || st.st_size <= 0) {
+        LOG_ERR("Cannot stat %s", path);
+        close(fd);
+        return NULL;
+    }
+
+    uint8_t *buf = malloc(st.st_size);
+    if (buf == NULL) {
+        LOG_ERR("Cannot allocate %lld bytes for %s", (long long)st.st_size,
+                path);
+        close(fd);
+        return NULL;
+    }
+
+    // read() may return short counts for large files.
+    size_t done = 0;
+    while (done < (size_t)st.st_size) {
+        ssize_t n = read(fd, buf + done, st.st_size - done);
+        if (n <= 0) {
+            LOG_ERR("Short read on %s (%zu of %lld bytes)", path, done,
+                    (long long)st.st_size);
+            free(buf);
+            close(fd);
+            return NULL;
+        }
+        done += n;
+    }
+    close(fd);
+
+    *size = done;
+    return buf;
+}
+
+size_t
+model_file_memory_size(void)
+{
+#ifdef __wasm__
+    return __builtin_wasm_memory_size(0) * 65536;
+#else
+    return 0;
+#endif
+}
@@ -0,0 +1,324 @@
+#include "raster.h"
+
+#include <string.h>
+
+#ifdef __wasm_simd128__
+#include <wasm_simd128.h>
+#endif
+
+// 5x7 glyphs for ASCII 0x20..0x7e, one byte per row with the leftmost pixel
+// in bit 4.
+static const uint8_t font[][RASTER_GLYPH_HEIGHT] = {
+    {0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00}, // space
+    {0x04, 0x04, 0x04, 0x04, 0x04, 0x00, 0x04}, // !
+    {0x0a, 0x0a, 0x0a, 0x00, 0x00, 0x00, 0x00}, // "
+    {0x0a, 0x0a, 0x1f, 0x0a, 0x1f, 0x0a, 0x0a}, // #
+    {0x04, 0x0f, 0x14, 0x0e, 0x05, 0x1e, 0x04}, // $
+    {0x18, 0x19, 0x02, 0x04, 0x08, 0x13, 0x03}, // %
+    {0x0c, 0x12, 0x14, 0x08, 0x15, 0x12, 0x0d}, // &
+    {0x0c, 0x04, 0x08, 0x00, 0x00, 0x00, 0x00}, // '
+    {0x02, 0x04, 0x08, 0x08, 0x08, 0x04, 0x02}, // (
+    {0x08, 0x04, 0x02, 0x02, 0x02, 0x04, 0x08}, // )
+    {0x00, 0x0a, 0x04, 0x1f, 0x04, 0x0a, 0x00}, // *
+    {0x00, 0x04, 0x04, 0x1f, 0x04, 0x04, 0x00}, // +
+    {0x00, 0x00, 0x00, 0x00, 0x0c, 0x04, 0x08}, // ,
+    {0x00, 0x00, 0x00, 0x1f, 0x00, 0x00, 0x00}, // -
+    {0x00, 0x00, 0x00, 0x00, 0x00, 0x0c, 0x0c}, // .
+    {0x00, 0x01, 0x02, 0x04, 0x08, 0x10, 0x00}, // /
+    {0x0e, 0x11, 0x13, 0x15, 0x19, 0x11, 0x0e}, // 0
+    {0x04, 0x0c, 0x04, 0x04, 0x04, 0x04, 0x0e}, // 1
+    {0x0e, 0x11, 0x01, 0x02, 0x04, 0x08, 0x1f}, // 2
+    {0x1f, 0x02, 0x04, 0x02, 0x01, 0x11, 0x0e}, // 3
+    {0x02, 0x06, 0x0a, 0x12, 0x1f, 0x02, 0x02}, // 4
+    {0x1f, 0x10, 0x1e, 0x01, 0x01, 0x11, 0x0e}, // 5
+    {0x06, 0x08, 0x10, 0x1e, 0x11, 0x11, 0x0e}, // 6
+    {0x1f, 0x01, 0x02, 0x04, 0x08, 0x08, 0x08}, // 7
+    {0x0e, 0x11, 0x11, 0x0e, 0x11, 0x11, 0x0e}, // 8
+    {0x0e, 0x11, 0x11, 0x0f, 0x01, 0x02, 0x0c}, // 9
+    {0x00, 0x0c, 0x0c, 0x00, 0x0c, 0x0c, 0x00}, // :
+    {0x00, 0x0c, 0x0c, 0x00, 0x0c, 0x04, 0x08}, // ;
+    {0x02, 0x04, 0x08, 0x10, 0x08, 0x04, 0x02}, // <
+    {0x00, 0x00, 0x1f, 0x00, 0x1f, 0x00, 0x00}, // =
+    {0x08, 0x04, 0x02, 0x01, 0x02, 0x04, 0x08}, // >
+    {0x0e, 0x11, 0x01, 0x02, 0x04, 0x00, 0x04}, // ?
+    {0x0e, 0x11, 0x01, 0x0d, 0x15, 0x15, 0x0e}, // @
+    {0x0e, 0x11, 0x11, 0x11, 0x1f, 0x11, 0x11}, // A
+    {0x1e, 0x11, 0x11, 0x1e, 0x11, 0x11, 0x1e}, // B
+    {0x0e, 0x11, 0x10, 0x10, 0x10, 0x11, 0x0e}, // C
+    {0x1c, 0x12, 0x11, 0x11, 0x11, 0x12, 0x1c}, // D
+    {0x1f, 0x10, 0x10, 0x1e, 0x10, 0x10, 0x1f}, // E
+    {0x1f, 0x10, 0x10, 0x1e, 0x10, 0x10, 0x10}, // F
+    {0x0e, 0x11, 0x10, 0x17, 0x11, 0x11, 0x0f}, // G
+    {0x11, 0x11, 0x11, 0x1f, 0x11, 0x11, 0x11}, // H
+    {0x0e, 0x04, 0x04, 0x04, 0x04, 0x04, 0x0e}, // I
+    {0x07, 0x02, 0x02, 0x02, 0x02, 0x12, 0x0c}, // J
+    {0x11, 0x12, 0x14, 0x18, 0x14, 0x12, 0x11}, // K
+    {0x10, 0x10, 0x10, 0x10, 0x10, 0x10, 0x1f}, // L
+    {0x11, 0x1b, 0x15, 0x15, 0x11, 0x11, 0x11}, // M
+    {0x11, 0x11, 0x19, 0x15, 0x13, 0x11, 0x11}, // N
+    {0x0e, 0x11, 0x11, 0x11, 0x11, 0x11, 0x0e}, // O
+    {0x1e, 0x11, 0x11, 0x1e, 0x10, 0x10, 0x10}, // P
+    {0x0e, 0x11, 0x11, 0x11, 0x15, 0x12, 0x0d}, // Q
+    {0x1e, 0x11, 0x11, 0x1e, 0x14, 0x12, 0x11}, // R
+    {0x0f, 0x10, 0x10, 0x0e, 0x01, 0x01, 0x1e}, // S
+    {0x1f, 0x04, 0x04, 0x04, 0x04, 0x04, 0x04}, // T
+    {0x11, 0x11, 0x11, 0x11, 0x11, 0x11, 0x0e}, // U
+    {0x11, 0x11, 0x11, 0x11, 0x11, 0x0a, 0x04}, // V
+    {0x11, 0x11, 0x11, 0x15, 0x15, 0x15, 0x0a}, // W
+    {0x11, 0x11, 0x0a, 0x04, 0x0a, 0x11, 0x11}, // X
+    {0x11, 0x11, 0x11, 0x0a, 0x04, 0x04, 0x04}, // Y
+    {0x1f, 0x01, 0x02, 0x04, 0x08, 0x10, 0x1f}, // Z
+    {0x0e, 0x08, 0x08, 0x08, 0x08, 0x08, 0x0e}, // [
+    {0x00, 0x10, 0x08, 0x04, 0x02, 0x01, 0x00}, // backslash
+    {0x0e, 0x02, 0x02, 0x02, 0x02, 0x02, 0x0e}, // ]
+    {0x04, 0x0a, 0x11, 0x00, 0x00, 0x00, 0x00}, // ^
+    {0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x1f}, // _
+    {0x08, 0x04, 0x02, 0x00, 0x00, 0x00, 0x00}, // `
+    {0x00, 0x00, 0x0e, 0x01, 0x0f, 0x11, 0x0f}, // a
+    {0x10, 0x10, 0x16, 0x19, 0x11, 0x11, 0x1e}, // b
+    {0x00, 0x00, 0x0e, 0x10, 0x10, 0x11, 0x0e}, // c
+    {0x01, 0x01, 0x0d, 0x13, 0x11, 0x11, 0x0f}, // d
+    {0x00, 0x00, 0x0e, 0x11, 0x1f, 0x10, 0x0e}, // e
+    {0x06, 0x09, 0x08, 0x1c, 0x08, 0x08, 0x08}, // f
+    {0x00, 0x0f, 0x11, 0x11, 0x0f, 0x01, 0x0e}, // g
+    {0x10, 0x10, 0x16, 0x19, 0x11, 0x11, 0x11}, // h
+    {0x04, 0x00, 0x0c, 0x04, 0x04, 0x04, 0x0e}, // i
+    {0x02, 0x00, 0x06, 0x02, 0x02, 0x12, 0x0c}, // j
+    {0x10, 0x10, 0x12, 0x14, 0x18, 0x14, 0x12}, // k
+    {0x0c, 0x04, 0x04, 0x04, 0x04, 0x04, 0x0e}, // l
+    {0x00, 0x00, 0x1a, 0x15, 0x15, 0x11, 0x11}, // m
+    {0x00, 0x00, 0x16, 0x19, 0x11, 0x11, 0x11}, // n
+    {0x00, 0x00, 0x0e, 0x11, 0x11, 0x11, 0x0e}, // o
+    {0x00, 0x00, 0x1e, 0x11, 0x1e, 0x10, 0x10}, // p
+    {0x00, 0x00, 0x0d, 0x13, 0x0f, 0x01, 0x01}, // q
+    {0x00, 0x00, 0x16, 0x19, 0x10, 0x10, 0x10}, // r
+    {0x00, 0x00, 0x0e, 0x10, 0x0e, 0x01, 0x1e}, // s
+    {0x08, 0x08, 0x1c, 0x08, 0x08, 0x09, 0x06}, // t
+    {0x00, 0x00, 0x11, 0x11, 0x11, 0x13, 0x0d}, // u
+    {0x00, 0x00, 0x11, 0x11, 0x11, 0x0a, 0x04}, // v
+    {0x00, 0x00, 0x11, 0x11, 0x15, 0x15, 0x0a}, // w
+    {0x00, 0x00, 0x11, 0x0a, 0x04, 0x0a, 0x11}, // x
+    {0x00, 0x00, 0x11, 0x11, 0x0f, 0x01, 0x0e}, // y
+    {0x00, 0x00, 0x1f, 0x02, 0x04, 0x08, 0x1f}, // z
+    {0x02, 0x04, 0x04, 0x08, 0x04, 0x04, 0x02}, // {
+    {0x04, 0x04, 0x04, 0x04, 0x04, 0x04, 0x04}, // |
+    {0x08, 0x04, 0x04, 0x02, 0x04, 0x04, 0x08}, // }
+    {0x00, 0x00, 0x08, 0x15, 0x02, 0x00, 0x00}, // ~
+};
+
+static int32_t
+clamp(int32_t v, int32_t lo, int32_t hi)
+{
+    return v < lo ? lo : v > hi ? hi : v;
+}
+
+// Fill `n` pixels. Gray is a plain memset; other colors write one pixel and
+// then double the filled run with memcpy, so a span costs O(log n) calls.
+static void
+fill_span(uint8_t *p, uint32_t n, raster_color_t color)
+{
+    if (color.r == color.g && color.g == color.b) {
+        memset(p, color.r, n * 3);
+        return;
+    }
+    p[0] = color.r;
+    p[1] = color.g;
+    p[2] = color.b;
+    uint32_t done = 3, total = n * 3;
+    while (done < total) {
+        uint32_t chunk = done < total - done ? done : total - done;
+        memcpy(p + done, p, chunk);
+        done += chunk;
+    }
+}
+
+void
+raster_hline(const raster_image_t *img, int32_t x0, int32_t x1, int32_t y,
+             raster_color_t color)
+{
+    raster_fill_rect(img, x0, y, x1, y, color);
+}
+
+void
+raster_vline(const raster_image_t *img, int32_t x, int32_t y0, int32_t y1,
+             raster_color_t color)
+{
+    raster_fill_rect(img, x, y0, x, y1, color);
+}
+
+void
+raster_fill_rect(const raster_image_t *img, int32_t x0, int32_t y0,
+                 int32_t x1, int32_t y1, raster_color_t color)
+{
+    if (x0 > x1 || y0 > y1 || x1 < 0 || y1 < 0 || x0 >= (int32_t)img->width ||
+        y0 >= (int32_t)img->height)
+        return;
+    x0 = clamp(x0, 0, img->width - 1);
+    x1 = clamp(x1, 0, img->width - 1);
+    y0 = clamp(y0, 0, img->height - 1);
+    y1 = clamp(y1, 0, img->height - 1);
+
+    size_t stride = (size_t)img->width * 3;
+    uint8_t *row = img->data + y0 * stride + x0 * 3;
+    uint32_t n = x1 - x0 + 1;
+    if (n == 1) {
+        // Column: one pixel per row.
+        for (int32_t y = y0; y <= y1; ++y, row += stride) {
+            row[0] = color.r;
+            row[1] = color.g;
+            row[2] = color.b;
+        }
+        return;
+    }
+    // Fill the first row, then copy it down.
+    fill_span(row, n, color);
+    for (int32_t y = y0 + 1; y <= y1; ++y)
+        memcpy(row + (y - y0) * stride, row, n * 3);
+}
+
+// Blend `n` pixels towards `color`: p = (p * (256 - alpha) + c * alpha +
+// 128) >> 8 per channel, which never leaves 16 bits.
+static void
+blend_span(uint8_t *p, uint32_t n, raster_color_t color, uint32_t alpha)
+{
+    const uint16_t inv = 256 - alpha;
+    const uint16_t ca[3] = {color.r * alpha + 128, color.g * alpha + 128,
+                            color.b * alpha + 128};
+    uint32_t i = 0, total = n * 3;
+#ifdef __wasm_simd128__
+    // 48 bytes are 16 whole pixels; the color pattern of each 16-byte
+    // vector starts at channel 0, 1 and 2 in turn.
+    v128_t lo[3], hi[3];
+    for (int k = 0; k < 3; ++k) {
+        uint16_t c[16];
+        for (int j = 0; j < 16; ++j)
+            c[j] = ca[(k * 16 + j) % 3];
+        lo[k] = wasm_v128_load(c);
+        hi[k] = wasm_v128_load(c + 8);
+    }
+    const v128_t vinv = wasm_i16x8_splat(inv);
+    for (; i + 48 <= total; i += 48) {
+        for (int k = 0; k < 3; ++k) {
+            v128_t d = wasm_v128_load(p + i + k * 16);
+            v128_t l = wasm_i16x8_add(
+                wasm_i16x8_mul(wasm_u16x8_extend_low_u8x16(d), vinv), lo[k]);
+            v128_t h = wasm_i16x8_add(
+                wasm_i16x8_mul(wasm_u16x8_extend_high_u8x16(d), vinv), hi[k]);
+            wasm_v128_store(p + i + k * 16,
+                            wasm_u8x16_narrow_i16x8(wasm_u16x8_shr(l, 8),
+                                                    wasm_u16x8_shr(h, 8)));
+        }
+    }
+#endif
+    for (; i < total; ++i)
+        p[i] = (p[i] * inv + ca[i % 3]) >> 8;
+}
+
+void
+raster_blend_rect(const raster_image_t *img, int32_t x0, int32_t y0,
+                  int32_t x1, int32_t y1, raster_color_t color,
+                  uint32_t alpha)
+{
+    if (alpha == 0 || x0 > x1 || y0 > y1 || x1 < 0 || y1 < 0 ||
+        x0 >= (int32_t)img->width || y0 >= (int32_t)img->height)
+        return;
+    if (alpha >= 256) {
+        raster_fill_rect(img, x0, y0, x1, y1, color);
+        return;
+    }
+    x0 = clamp(x0, 0, img->width - 1);
+    x1 = clamp(x1, 0, img->width - 1);
+    y0 = clamp(y0, 0, img->height - 1);
+    y1 = clamp(y1, 0, img->height - 1);
+
+    size_t stride = (size_t)img->width * 3;
+    uint8_t *row = img->data + y0 * stride + x0 * 3;
+    for (int32_t y = y0; y <= y1; ++y, row += stride)
+        blend_span(row, x1 - x0 + 1, color, alpha);
+}
+
+void
+raster_rect(const raster_image_t *img, int32_t x0, int32_t y0, int32_t x1,
+            int32_t y1, uint32_t thickness, raster_color_t color)
+{
+    if (x0 > x1 || y0 > y1 || thickness == 0)
+        return;
+    int32_t t = (int32_t)thickness;
+    // Bands that would overlap collapse into a filled rectangle.
+    if (2 * t > x1 - x0 || 2 * t > y1 - y0) {
+        raster_fill_rect(img, x0, y0, x1, y1, color);
+        return;
+    }
+    raster_fill_rect(img, x0, y0, x1, y0 + t - 1, color);
+    raster_fill_rect(img, x0, y1 - t + 1, x1, y1, color);
+    raster_fill_rect(img, x0, y0 + t, x0 + t - 1, y1 - t, color);
+    raster_fill_rect(img, x1 - t + 1, y0 + t, x1, y1 - t, color);
+}
+
+static const uint8_t *
+glyph(char c)
+{
+    unsigned char u = (unsigned char)c;
+    if (u < 0x20 || u > 0x7e)
+        u = '?';
+    return font[u - 0x20];
+}
+
+uint32_t
+raster_text_width(const char *text)
+{
+    size_t n = strlen(text);
+    return n == 0 ? 0 : n * RASTER_GLYPH_ADVANCE - 1;
+}
+
+void
+raster_text(const raster_image_t *img, int32_t x, int32_t y, const char *text,
+            raster_color_t color)
+{
+    int32_t r0 = y < 0 ? -y : 0;
+    int32_t r1 = (int32_t)img->height - y;
+    if (r1 > RASTER_GLYPH_HEIGHT)
+        r1 = RASTER_GLYPH_HEIGHT;
+    size_t stride = (size_t)img->width * 3;
+    for (; *text != '\0' && x < (int32_t)img->width;
+         ++text, x += RASTER_GLYPH_ADVANCE) {
+        if (x + RASTER_GLYPH_WIDTH <= 0)
+            continue;
+        const uint8_t *g = glyph(*text);
+        for (int32_t r = r0; r < r1; ++r) {
+            uint8_t *row = img->data + (y + r) * stride;
+            for (int32_t c = 0; c < RASTER_GLYPH_WIDTH; ++c) {
+                int32_t px = x + c;
+                if (!(g[r] & (0x10 >> c)) || px < 0 ||
+                    px >= (int32_t)img->width)
+                    continue;
+                row[px * 3] = color.r;
+                row[px * 3 + 1] = color.g;
+                row[px * 3 + 2] = color.b;
+            }
+        }
+    }
+}
+
+void
+raster_label(const raster_image_t *img, int32_t x, int32_t y,
+             const char *text, raster_color_t background)
+{
+    int32_t w = (int32_t)raster_text_width(text) + 2;
+    int32_t h = RASTER_GLYPH_HEIGHT + 2;
+    // Above the box, or inside it when it touches the top of the image.
+    if (y >= h)
+        y -= h;
+    // Keep labels of boxes at the right edge readable.
+    if (x + w > (int32_t)img->width)
+        x = (int32_t)img->width - w;
+    if (x < 0)
+        x = 0;
+    // Black on light colors, white on dark ones
+    uint32_t luma = 299 * background.r + 587 * background.g +
+                    114 * background.b;
+    raster_color_t fg = luma > 128 * 1000 ? (raster_color_t){0, 0, 0}
+                                          : (raster_color_t){255, 255, 255};
+    raster_fill_rect(img, x, y, x + w - 1, y + h - 1, background);
+    raster_text(img, x + 1, y + 1, text, fg);
+}
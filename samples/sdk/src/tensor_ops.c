@@ -0,0 +1,120 @@
+#include "tensor_ops.h"
+
+#include <math.h>
+
+#ifdef __wasm_simd128__
+#include <wasm_simd128.h>
+#endif
+
+#define NORMALIZE_SCALE (1.0f / 255)
+
+void
+tensor_normalize_u8(const uint8_t *src, float *dst, uint32_t n)
+{
+    uint32_t i = 0;
+#ifdef __wasm_simd128__
+    const v128_t scale = wasm_f32x4_splat(NORMALIZE_SCALE);
+    for (; i + 16 <= n; i += 16) {
+        v128_t b = wasm_v128_load(src + i);
+        v128_t lo = wasm_u16x8_extend_low_u8x16(b);
+        v128_t hi = wasm_u16x8_extend_high_u8x16(b);
+        v128_t f0 = wasm_f32x4_convert_u32x4(wasm_u32x4_extend_low_u16x8(lo));
+        v128_t f1 = wasm_f32x4_convert_u32x4(wasm_u32x4_extend_high_u16x8(lo));
+        v128_t f2 = wasm_f32x4_convert_u32x4(wasm_u32x4_extend_low_u16x8(hi));
+        v128_t f3 = wasm_f32x4_convert_u32x4(wasm_u32x4_extend_high_u16x8(hi));
+        wasm_v128_store(dst + i, wasm_f32x4_mul(f0, scale));
+        wasm_v128_store(dst + i + 4, wasm_f32x4_mul(f1, scale));
+        wasm_v128_store(dst + i + 8, wasm_f32x4_mul(f2, scale));
+        wasm_v128_store(dst + i + 12, wasm_f32x4_mul(f3, scale));
+    }
+#endif
+    for (; i < n; ++i)
+        dst[i] = (float)src[i] * NORMALIZE_SCALE;
+}
+
+uint32_t
+tensor_count_leading_ge(const float *values, uint32_t n, float threshold)
+{
+    uint32_t i = 0;
+#ifdef __wasm_simd128__
+    const v128_t t = wasm_f32x4_splat(threshold);
+    for (; i + 4 <= n; i += 4) {
+        uint32_t mask =
+            wasm_i32x4_bitmask(wasm_f32x4_ge(wasm_v128_load(values + i), t));
+        if (mask != 0xf)
+            return i + __builtin_ctz(~mask);
+    }
+#endif
+    for (; i < n; ++i) {
+        if (!(values[i] >= threshold))
+            break;
+    }
+    return i;
+}
+
+uint32_t
+tensor_find_ge(const float *values, uint32_t n, float threshold,
+               uint32_t *indices, uint32_t max)
+{
+    uint32_t i = 0, found = 0;
+#ifdef __wasm_simd128__
+    // Most values are below the threshold, so whole vectors are skipped.
+    const v128_t t = wasm_f32x4_splat(threshold);
+    for (; i + 4 <= n; i += 4) {
+        uint32_t mask =
+            wasm_i32x4_bitmask(wasm_f32x4_ge(wasm_v128_load(values + i), t));
+        while (mask != 0) {
+            if (found == max)
+                return found;
+            indices[found++] = i + __builtin_ctz(mask);
+            mask &= mask - 1;
+        }
+    }
+#endif
+    for (; i < n; ++i) {
+        if (values[i] >= threshold) {
+            if (found == max)
+                return found;
+            indices[found++] = i;
+        }
+    }
+    return found;
+}
+
+void
+tensor_u8_to_i8(const uint8_t *src, uint8_t *dst, uint32_t n)
+{
+    uint32_t i = 0;
+#ifdef __wasm_simd128__
+    const v128_t bias = wasm_i8x16_splat((int8_t)0x80);
+    for (; i + 16 <= n; i += 16)
+        wasm_v128_store(dst + i,
+                        wasm_v128_xor(wasm_v128_load(src + i), bias));
+#endif
+    for (; i < n; ++i)
+        dst[i] = src[i] ^ 0x80;
+}
+
+void
+tensor_quantize_f32(const float *src, uint8_t *dst, uint32_t n, float scale,
+                    int32_t zero_point, bool is_signed)
+{
+    int32_t lo = is_signed ? -128 : 0;
+    int32_t hi = is_signed ? 127 : 255;
+    float inv = 1.0f / scale;
+
+    for (uint32_t i = 0; i < n; ++i) {
+        int32_t q = (int32_t)lroundf(src[i] * inv) + zero_point;
+        dst[i] = (uint8_t)(q < lo ? lo : (q > hi ? hi : q));
+    }
+}
+
+void
+tensor_dequantize_8(const uint8_t *src, float *dst, uint32_t n, float scale,
+                    int32_t zero_point, bool is_signed)
+{
+    for (uint32_t i = 0; i < n; ++i) {
+        int32_t q = is_signed ? (int8_t)src[i] : src[i];
+        dst[i] = (q - zero_point) * scale;
+    }
+}
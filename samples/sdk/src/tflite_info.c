@@ -0,0 +1,181 @@
+#include "tflite_info.h"
+
+#include <string.h>
+
+// Minimal read-only walk over the TFLite flatbuffer schema. Only the fields
+// needed to describe the graph inputs and outputs are decoded.
+
+// tflite::Model fields
+#define MODEL_SUBGRAPHS 2
+// tflite::SubGraph fields
+#define SUBGRAPH_TENSORS 0
+#define SUBGRAPH_INPUTS  1
+#define SUBGRAPH_OUTPUTS 2
+// tflite::Tensor fields
+#define TENSOR_SHAPE           0
+#define TENSOR_TYPE            1
+#define TENSOR_QUANTIZATION    4
+#define TENSOR_SHAPE_SIGNATURE 7
+// tflite::QuantizationParameters fields
+#define QUANT_SCALE      2
+#define QUANT_ZERO_POINT 3
+
+typedef struct {
+    const uint8_t *buf;
+    size_t size;
+} fb_t;
+
+static int
+fb_u32(const fb_t *fb, size_t pos, uint32_t *v)
+{
+    if (pos + 4 > fb->size)
+        return -1;
+    memcpy(v, fb->buf + pos, 4);
+    return 0;
+}
+
+static int
+fb_u16(const fb_t *fb, size_t pos, uint16_t *v)
+{
+    if (pos + 2 > fb->size)
+        return -1;
+    memcpy(v, fb->buf + pos, 2);
+    return 0;
+}
+
+// Position of field `id` of the table at `table`, or 0 if absent.
+static size_t
+fb_field(const fb_t *fb, size_t table, uint16_t id)
+{
+    uint32_t soffset;
+    if (fb_u32(fb, table, &soffset) != 0)
+        return 0;
+    size_t vtable = table - (int32_t)soffset;
+    uint16_t vtable_size, field_offset;
+    if (vtable >= fb->size || fb_u16(fb, vtable, &vtable_size) != 0)
+        return 0;
+    uint16_t voffset = 4 + 2 * id;
+    if (voffset >= vtable_size ||
+        fb_u16(fb, vtable + voffset, &field_offset) != 0 || field_offset == 0)
+        return 0;
+    return table + field_offset;
+}
+
+// Follow the uoffset stored in field `id` (table, vector or string).
+static size_t
+fb_deref(const fb_t *fb, size_t table, uint16_t id)
+{
+    size_t pos = fb_field(fb, table, id);
+    uint32_t off;
+    if (pos == 0 || fb_u32(fb, pos, &off) != 0 || pos + off >= fb->size)
+        return 0;
+    return pos + off;
+}
+
+// Vector at `vec`: element count in *len, first element position returned.
+static size_t
+fb_vector(const fb_t *fb, size_t vec, uint32_t *len)
+{
+    if (vec == 0 || fb_u32(fb, vec, len) != 0)
+        return 0;
+    return vec + 4;
+}
+
+static size_t
+fb_table_at(const fb_t *fb, size_t vec_data, uint32_t i)
+{
+    size_t pos = vec_data + 4 * i;
+    uint32_t off;
+    if (fb_u32(fb, pos, &off) != 0 || pos + off >= fb->size)
+        return 0;
+    return pos + off;
+}
+
+static int
+tensor_info(const uint8_t *model, size_t size, uint16_t io_field,
+            uint32_t index, tflite_tensor_info_t *info)
+{
+    fb_t fb = {model, size};
+    uint32_t root, len;
+
+    if (size < 8 || memcmp(model + 4, "TFL3", 4) != 0 ||
+        fb_u32(&fb, 0, &root) != 0)
+        return -1;
+
+    size_t subgraphs =
+        fb_vector(&fb, fb_deref(&fb, root, MODEL_SUBGRAPHS), &len);
+    if (subgraphs == 0 || len == 0)
+        return -1;
+    size_t subgraph = fb_table_at(&fb, subgraphs, 0);
+
+    size_t io = fb_vector(&fb, fb_deref(&fb, subgraph, io_field), &len);
+    uint32_t tensor_index;
+    if (io == 0 || index >= len || fb_u32(&fb, io + 4 * index, &tensor_index))
+        return -1;
+
+    size_t tensors =
+        fb_vector(&fb, fb_deref(&fb, subgraph, SUBGRAPH_TENSORS), &len);
+    if (tensors == 0 || tensor_index >= len)
+        return -1;
+    size_t tensor = fb_table_at(&fb, tensors, tensor_index);
+    if (tensor == 0)
+        return -1;
+
+    memset(info, 0, sizeof(*info));
+    size_t type = fb_field(&fb, tensor, TENSOR_TYPE);
+    info->type = type && type < size ? (tflite_type_t)model[type]
+                                     : TFLITE_FLOAT32;
+
+    size_t shape = fb_vector(&fb, fb_deref(&fb, tensor, TENSOR_SHAPE), &len);
+    if (shape == 0 || len > TFLITE_MAX_DIMS)
+        return -1;
+    info->num_dims = len;
+    for (uint32_t i = 0; i < len; ++i) {
+        if (fb_u32(&fb, shape + 4 * i, &info->dims[i]) != 0)
+            return -1;
+    }
+
+    size_t signature =
+        fb_vector(&fb, fb_deref(&fb, tensor, TENSOR_SHAPE_SIGNATURE), &len);
+    uint32_t batch;
+    if (signature != 0 && len == info->num_dims && len > 0 &&
+        fb_u32(&fb, signature, &batch) == 0)
+        info->dynamic_batch = (int32_t)batch == -1;
+
+    size_t quant = fb_deref(&fb, tensor, TENSOR_QUANTIZATION);
+    if (quant != 0) {
+        size_t scale = fb_vector(&fb, fb_deref(&fb, quant, QUANT_SCALE), &len);
+        uint32_t bits;
+        if (scale != 0 && len > 0 && fb_u32(&fb, scale, &bits) == 0)
+            memcpy(&info->scale, &bits, 4);
+        // zero_point is a vector of int64; the low word is enough here.
+        size_t zp =
+            fb_vector(&fb, fb_deref(&fb, quant, QUANT_ZERO_POINT), &len);
+        if (zp != 0 && len > 0 && fb_u32(&fb, zp, &bits) == 0)
+            info->zero_point = (int32_t)bits;
+    }
+    return 0;
+}
+
+int
+tflite_input_info(const uint8_t *model, size_t size, uint32_t index,
+                  tflite_tensor_info_t *info)
+{
+    return tensor_info(model, size, SUBGRAPH_INPUTS, index, info);
+}
+
+int
+tflite_output_info(const uint8_t *model, size_t size, uint32_t index,
+                   tflite_tensor_info_t *info)
+{
+    return tensor_info(model, size, SUBGRAPH_OUTPUTS, index, info);
+}
+
+uint32_t
+tflite_num_elements(const tflite_tensor_info_t *info)
+{
+    uint32_t n = 1;
+    for (uint32_t i = 0; i < info->num_dims; ++i)
+        n *= info->dims[i];
+    return n;
+}